@@ -1,15 +1,44 @@
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <cstdlib>
 
 using namespace llvm;
 
 namespace {
 
+// How to recover the size of an allocation function's result
+struct AllocSummary {
+  enum SizeKind { Bytes, String };
+
+  SizeKind Kind = Bytes;
+  int SizeArg = -1;  // Byte size, or the source string for String
+  int CountArg = -1; // Element count, or the strnlen bound for String
+  int OutArg = -1;   // Out-parameter receiving the pointer, if any
+};
+
+// Allocators the loader serves from the sandbox heap. Others, such as
+// reallocarray, pvalloc or operator new, return host memory, so their
+// results must not be assumed in bounds.
+static const std::pair<const char *, AllocSummary> KnownAllocators[] = {
+    {"malloc", {AllocSummary::Bytes, 0, -1, -1}},
+    {"calloc", {AllocSummary::Bytes, 0, 1, -1}},
+    {"realloc", {AllocSummary::Bytes, 1, -1, -1}},
+    {"aligned_alloc", {AllocSummary::Bytes, 1, -1, -1}},
+    {"memalign", {AllocSummary::Bytes, 1, -1, -1}},
+    {"valloc", {AllocSummary::Bytes, 0, -1, -1}},
+    {"posix_memalign", {AllocSummary::Bytes, 2, -1, 0}},
+    {"strdup", {AllocSummary::String, 0, -1, -1}},
+    {"strndup", {AllocSummary::String, 0, 1, -1}},
+};
+
 struct CheckedPtrSet {
   SmallPtrSet<Value *, 16> Seen;
   bool contains(Value *V) const { return Seen.count(V); }
@@ -18,6 +47,9 @@ struct CheckedPtrSet {
 
 class BoundsCheckPass : public PassInfoMixin<BoundsCheckPass> {
 public:
+  // Write-only mode leaves loads unchecked for integrity-only tenants
+  explicit BoundsCheckPass(bool WriteOnly = false) : WriteOnly(WriteOnly) {}
+
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
     LLVMContext &Ctx = M.getContext();
     const DataLayout &DL = M.getDataLayout();
@@ -27,13 +59,22 @@ public:
     // Runtime function for bounds checking
     FunctionCallee BoundsCheckFn = M.getOrInsertFunction(
         "__bounds_check",
-        FunctionType::get(I8PtrTy, {I8PtrTy, Int64Ty}, false));
+        FunctionType::get(I8PtrTy, {I8PtrTy, Int64Ty, Int64Ty}, false));
+
+    // Runtime function for clamping memory intrinsic lengths
+    FunctionCallee BoundsCheckLenFn = M.getOrInsertFunction(
+        "__bounds_check_len",
+        FunctionType::get(Int64Ty, {I8PtrTy, Int64Ty, Int64Ty}, false));
 
     // Runtime function for bounds assumptions
     FunctionCallee BoundsAssumeFn = M.getOrInsertFunction(
         "__bounds_assume",
         FunctionType::get(Type::getVoidTy(Ctx), {I8PtrTy, Int64Ty}, false));
 
+    StringMap<AllocSummary> Allocators = buildAllocators();
+
+    mergeGlobals(M);
+
     // Annotate assumptions in entry
     Function *EntryFn = M.getFunction("entry");
     if (EntryFn && !EntryFn->isDeclaration()) {
@@ -42,6 +83,9 @@ public:
       instrumentGlobals(M, B, BoundsAssumeFn);
     }
 
+    // Number checks so trapping runtimes can report the faulting site
+    uint64_t CheckID = 0;
+
     for (Function &F : M) {
       if (F.isDeclaration()) {
         continue;
@@ -57,24 +101,30 @@ public:
 
           // Annotate memory accesses
           if (auto *LI = dyn_cast<LoadInst>(&I)) {
+            if (WriteOnly) {
+              continue;
+            }
             instrumentPointer(B, LI, LI->getPointerOperand(),
                               getTypeStoreSize(M, LI->getType()), BoundsCheckFn,
-                              BlockSeen, DL);
+                              BlockSeen, CheckID, DL);
           } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
             instrumentPointer(
                 B, SI, SI->getPointerOperand(),
                 getTypeStoreSize(M, SI->getValueOperand()->getType()),
-                BoundsCheckFn, BlockSeen, DL);
+                BoundsCheckFn, BlockSeen, CheckID, DL);
           } else if (auto *AMW = dyn_cast<AtomicRMWInst>(&I)) {
             instrumentPointer(
                 B, AMW, AMW->getPointerOperand(),
                 getTypeStoreSize(M, AMW->getValOperand()->getType()),
-                BoundsCheckFn, BlockSeen, DL);
+                BoundsCheckFn, BlockSeen, CheckID, DL);
           } else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
             instrumentPointer(
                 B, CX, CX->getPointerOperand(),
                 getTypeStoreSize(M, CX->getNewValOperand()->getType()),
-                BoundsCheckFn, BlockSeen, DL);
+                BoundsCheckFn, BlockSeen, CheckID, DL);
+          } else if (auto *MI = dyn_cast<MemIntrinsic>(&I)) {
+            instrumentMemIntrinsic(B, MI, !WriteOnly, BoundsCheckLenFn, CheckID,
+                                   DL);
           }
 
           // Assume stack allocations are safe
@@ -91,44 +141,60 @@ public:
 
           // Assume heap allocations are safe
           else if (auto *Call = dyn_cast<CallBase>(&I)) {
-            Function *Callee = Call->getCalledFunction();
-            if (!Callee || isa<InvokeInst>(Call)) {
+            AllocSummary Summary;
+            if (!getAllocSummary(Call, Allocators, Summary)) {
               continue;
             }
 
-            StringRef Name = Callee->getName();
-            bool IsMalloc = Name.equals("malloc");
-            bool IsCalloc = Name.equals("calloc");
-            bool IsRealloc = Name.equals("realloc");
-
-            if ((IsMalloc || IsCalloc || IsRealloc) &&
-                Call->getType()->isPointerTy()) {
-              B.SetInsertPoint(I.getNextNode());
-
-              Value *SizeVal = ConstantInt::get(Int64Ty, 0);
-              if (IsCalloc && Call->arg_size() >= 2) {
-                Value *Count =
-                    B.CreateZExtOrTrunc(Call->getArgOperand(0), Int64Ty);
-                Value *ElemSize =
-                    B.CreateZExtOrTrunc(Call->getArgOperand(1), Int64Ty);
-                SizeVal = B.CreateMul(Count, ElemSize);
-              } else if (IsRealloc && Call->arg_size() >= 2) {
-                SizeVal = B.CreateZExtOrTrunc(Call->getArgOperand(1), Int64Ty);
-              } else if (IsMalloc && Call->arg_size() >= 1) {
-                SizeVal = B.CreateZExtOrTrunc(Call->getArgOperand(0), Int64Ty);
+            if (auto *II = dyn_cast<InvokeInst>(Call)) {
+              // Results are only available on the normal edge
+              BasicBlock *Normal = II->getNormalDest();
+              if (Summary.OutArg < 0 && Normal->getSinglePredecessor()) {
+                B.SetInsertPoint(&*Normal->getFirstInsertionPt());
+                instrumentAllocation(M, B, Call, Summary, BoundsAssumeFn,
+                                     BoundsCheckFn, CheckID, DL);
               }
-
-              injectCall(B, BoundsAssumeFn, Call, SizeVal);
+              continue;
             }
+
+            B.SetInsertPoint(I.getNextNode());
+            instrumentAllocation(M, B, Call, Summary, BoundsAssumeFn,
+                                 BoundsCheckFn, CheckID, DL);
+
+            // Skip over the summary code we just emitted
+            Inst = std::prev(B.GetInsertPoint());
           }
         }
       }
     }
 
+    recordPolicy(M);
     return PreservedAnalyses::none();
   }
 
 private:
+  bool WriteOnly;
+
+  // Tag the module and the resulting .so with the isolation policy.
+  // libfluke reads __fluke_policy and refuses builds that don't match the
+  // host's FLUKE_POLICY.
+  void recordPolicy(Module &M) const {
+    LLVMContext &Ctx = M.getContext();
+    StringRef Policy = WriteOnly ? "write-only" : "read-write";
+    M.addModuleFlag(Module::Error, "fluke.policy", MDString::get(Ctx, Policy));
+
+    if (M.getNamedValue("__fluke_policy")) {
+      report_fatal_error("bounds-check: module already defines __fluke_policy");
+    }
+
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *PolicyVar = new GlobalVariable(
+        M, Int32Ty, true, GlobalValue::ExternalLinkage,
+        ConstantInt::get(Int32Ty, WriteOnly ? 1 : 0), "__fluke_policy");
+    PolicyVar->setSection(".fluke");
+    appendToUsed(M, {PolicyVar});
+  }
+
   static uint64_t getTypeStoreSize(Module &M, Type *T) {
     return M.getDataLayout().getTypeStoreSize(T);
   }
@@ -142,33 +208,214 @@ private:
                       B.CreateZExtOrTrunc(Size, Int64Ty)});
   }
 
-  static bool isTriviallySafe(Value *Ptr, uint64_t AccessSize,
-                              const DataLayout &DL) {
-    Value *Stripped = Ptr->stripPointerCasts();
-    if (auto *AI = dyn_cast<AllocaInst>(Stripped)) {
-      if (AI->isArrayAllocation()) {
-        return false;
+  // Parse FLUKE_ALLOCATORS entries of the form name=size[*count][@out]
+  static StringMap<AllocSummary> buildAllocators() {
+    StringMap<AllocSummary> Table;
+    for (const auto &Entry : KnownAllocators) {
+      Table[Entry.first] = Entry.second;
+    }
+
+    const char *EnvStr = std::getenv("FLUKE_ALLOCATORS");
+    if (!EnvStr) {
+      return Table;
+    }
+
+    SmallVector<StringRef, 8> Entries;
+    StringRef(EnvStr).split(Entries, ',', -1, false);
+    for (StringRef Entry : Entries) {
+      Entry = Entry.trim();
+      StringRef Name, Spec;
+      std::tie(Name, Spec) = Entry.split('=');
+
+      AllocSummary Summary;
+      StringRef Out;
+      std::tie(Spec, Out) = Spec.split('@');
+      StringRef Size, Count;
+      std::tie(Size, Count) = Spec.split('*');
+
+      if (Name.empty() || Size.getAsInteger(10, Summary.SizeArg) ||
+          (!Count.empty() && Count.getAsInteger(10, Summary.CountArg)) ||
+          (!Out.empty() && Out.getAsInteger(10, Summary.OutArg))) {
+        errs() << "bounds-check: ignoring malformed allocator '" << Entry
+               << "'\n";
+        continue;
       }
 
-      uint64_t AllocSize = DL.getTypeAllocSize(AI->getAllocatedType());
-      return AccessSize <= AllocSize;
+      Table[Name] = Summary;
+    }
+
+    return Table;
+  }
+
+  static bool getAllocSummary(CallBase *Call,
+                              const StringMap<AllocSummary> &Allocators,
+                              AllocSummary &Summary) {
+    Function *Callee = Call->getCalledFunction();
+    if (!Callee) {
+      return false;
+    }
+
+    auto It = Allocators.find(Callee->getName());
+    if (It != Allocators.end()) {
+      Summary = It->second;
+    } else if (Call->hasFnAttr(Attribute::AllocSize)) {
+      // User-declared __attribute__((alloc_size(...)))
+      Attribute Attr = Call->getFnAttr(Attribute::AllocSize);
+      if (!Attr.isValid()) {
+        Attr = Callee->getFnAttribute(Attribute::AllocSize);
+      }
+
+      std::pair<unsigned, Optional<unsigned>> Args = Attr.getAllocSizeArgs();
+      Summary = AllocSummary();
+      Summary.SizeArg = Args.first;
+      Summary.CountArg = Args.second ? (int)*Args.second : -1;
+    } else {
+      return false;
+    }
+
+    int NumArgs = Call->arg_size();
+    if (Summary.SizeArg < 0 || Summary.SizeArg >= NumArgs ||
+        Summary.CountArg >= NumArgs || Summary.OutArg >= NumArgs) {
+      return false;
+    }
+
+    if (Summary.OutArg >= 0) {
+      return Call->getArgOperand(Summary.OutArg)->getType()->isPointerTy();
+    }
+
+    return Call->getType()->isPointerTy();
+  }
+
+  static void instrumentAllocation(Module &M, IRBuilder<> &B, CallBase *Call,
+                                   const AllocSummary &Summary,
+                                   FunctionCallee &AssumeFn,
+                                   FunctionCallee &CheckFn, uint64_t &CheckID,
+                                   const DataLayout &DL) {
+    LLVMContext &Ctx = M.getContext();
+    PointerType *I8PtrTy = PointerType::getUnqual(Type::getInt8Ty(Ctx));
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    Value *SizeArg = Call->getArgOperand(Summary.SizeArg);
+
+    Value *SizeVal;
+    if (Summary.Kind == AllocSummary::String) {
+      // Dead after the assumption is stubbed, so O3 removes the scan
+      Value *Str = B.CreatePointerCast(SizeArg, I8PtrTy);
+      if (Summary.CountArg >= 0) {
+        FunctionCallee StrnlenFn = M.getOrInsertFunction(
+            "strnlen", FunctionType::get(Int64Ty, {I8PtrTy, Int64Ty}, false));
+        Value *Bound = B.CreateZExtOrTrunc(
+            Call->getArgOperand(Summary.CountArg), Int64Ty);
+        SizeVal = B.CreateCall(StrnlenFn, {Str, Bound});
+      } else {
+        FunctionCallee StrlenFn = M.getOrInsertFunction(
+            "strlen", FunctionType::get(Int64Ty, {I8PtrTy}, false));
+        SizeVal = B.CreateCall(StrlenFn, {Str});
+      }
+      SizeVal = B.CreateAdd(SizeVal, ConstantInt::get(Int64Ty, 1));
+    } else {
+      SizeVal = B.CreateZExtOrTrunc(SizeArg, Int64Ty);
+      if (Summary.CountArg >= 0) {
+        Value *Count = B.CreateZExtOrTrunc(
+            Call->getArgOperand(Summary.CountArg), Int64Ty);
+        SizeVal = B.CreateMul(Count, SizeVal);
+      }
+    }
+
+    Value *Ptr = Call;
+    if (Summary.OutArg >= 0) {
+      // The pointer is only written on success, so fall back to null
+      Value *OutPtr = B.CreatePointerCast(Call->getArgOperand(Summary.OutArg),
+                                          PointerType::getUnqual(I8PtrTy));
+      LoadInst *Written = B.CreateLoad(I8PtrTy, OutPtr);
+
+      // The out-parameter is guest memory like any other
+      IRBuilder<> CheckB(Written);
+      CheckedPtrSet Fresh;
+      instrumentPointer(CheckB, Written, OutPtr,
+                        DL.getTypeStoreSize(I8PtrTy).getFixedSize(), CheckFn,
+                        Fresh, CheckID, DL);
+      Value *Ok = B.CreateICmpEQ(
+          Call, Constant::getNullValue(Call->getType()));
+      Ptr = B.CreateSelect(Ok, Written, ConstantPointerNull::get(I8PtrTy));
+    }
+
+    injectCall(B, AssumeFn, Ptr, SizeVal);
+  }
+
+  // Size of a known alloca or defined global, if fixed at compile time
+  static Optional<uint64_t> getObjectSize(Value *Obj, const DataLayout &DL) {
+    if (auto *AI = dyn_cast<AllocaInst>(Obj)) {
+      Optional<TypeSize> Bits = AI->getAllocationSizeInBits(DL);
+      if (!Bits || Bits->isScalable()) {
+        return None;
+      }
+      return Bits->getFixedSize() / 8;
     }
 
-    if (auto *GV = dyn_cast<GlobalVariable>(Stripped)) {
+    if (auto *GV = dyn_cast<GlobalVariable>(Obj)) {
       if (!GV->hasInitializer() && GV->hasExternalLinkage()) {
-        return false;
+        return None;
       }
+      return DL.getTypeAllocSize(GV->getValueType()).getFixedSize();
+    }
+
+    return None;
+  }
 
-      uint64_t AllocSize = DL.getTypeAllocSize(GV->getValueType());
-      return AccessSize <= AllocSize;
+  // Bytes addressable from Ptr within its underlying object, following
+  // constant offsets through phis and selects of known objects
+  static Optional<int64_t> getRemainingSize(Value *Ptr, const DataLayout &DL,
+                                            SmallPtrSetImpl<Value *> &Visited) {
+    APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+    Value *Base = Ptr->stripAndAccumulateConstantOffsets(DL, Offset, true);
+    if (Offset.isNegative()) {
+      return None;
     }
 
-    return false;
+    Optional<int64_t> Remaining;
+    if (isa<PHINode>(Base) || isa<SelectInst>(Base)) {
+      if (!Visited.insert(Base).second) {
+        return None;
+      }
+
+      SmallVector<Value *, 4> Incoming;
+      if (auto *PN = dyn_cast<PHINode>(Base)) {
+        Incoming.append(PN->incoming_values().begin(),
+                        PN->incoming_values().end());
+      } else {
+        auto *SI = cast<SelectInst>(Base);
+        Incoming.push_back(SI->getTrueValue());
+        Incoming.push_back(SI->getFalseValue());
+      }
+
+      for (Value *V : Incoming) {
+        Optional<int64_t> R = getRemainingSize(V, DL, Visited);
+        if (!R) {
+          return None;
+        }
+        Remaining = Remaining ? std::min(*Remaining, *R) : *R;
+      }
+    } else if (Optional<uint64_t> Size = getObjectSize(Base, DL)) {
+      Remaining = *Size;
+    }
+
+    if (!Remaining) {
+      return None;
+    }
+    return *Remaining - Offset.getSExtValue();
+  }
+
+  static bool isTriviallySafe(Value *Ptr, uint64_t AccessSize,
+                              const DataLayout &DL) {
+    SmallPtrSet<Value *, 8> Visited;
+    Optional<int64_t> Remaining = getRemainingSize(Ptr, DL, Visited);
+    return Remaining && *Remaining >= 0 &&
+           AccessSize <= (uint64_t)*Remaining;
   }
 
   static void instrumentPointer(IRBuilder<> &B, Instruction *MemInst,
                                 Value *Ptr, uint64_t Size, FunctionCallee &Fn,
-                                CheckedPtrSet &BlockSeen,
+                                CheckedPtrSet &BlockSeen, uint64_t &CheckID,
                                 const DataLayout &DL) {
     if (Size == 0 || BlockSeen.contains(Ptr) ||
         isTriviallySafe(Ptr, Size, DL)) {
@@ -183,7 +430,8 @@ private:
 
     Value *VoidPtr = B.CreatePointerCast(Ptr, I8PtrTy);
     Value *SizeVal = ConstantInt::get(Int64Ty, Size);
-    CallInst *MaskedVoidPtr = B.CreateCall(Fn, {VoidPtr, SizeVal});
+    Value *IDVal = ConstantInt::get(Int64Ty, ++CheckID);
+    CallInst *MaskedVoidPtr = B.CreateCall(Fn, {VoidPtr, SizeVal, IDVal});
     Value *MaskedTypedPtr = B.CreatePointerCast(MaskedVoidPtr, Ptr->getType());
 
     if (auto *LI = dyn_cast<LoadInst>(MemInst)) {
@@ -197,6 +445,150 @@ private:
     }
   }
 
+  static void instrumentMemIntrinsic(IRBuilder<> &B, MemIntrinsic *MI,
+                                     bool CheckSource, FunctionCallee &Fn,
+                                     uint64_t &CheckID, const DataLayout &DL) {
+    LLVMContext &Ctx = B.getContext();
+    PointerType *I8PtrTy = PointerType::getUnqual(Type::getInt8Ty(Ctx));
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+
+    SmallVector<Value *, 2> Ptrs{MI->getRawDest()};
+    if (auto *MT = dyn_cast<MemTransferInst>(MI)) {
+      if (CheckSource) {
+        Ptrs.push_back(MT->getRawSource());
+      }
+    }
+
+    // Constant lengths into known objects need no check
+    Value *OrigLen = MI->getLength();
+    if (auto *CLen = dyn_cast<ConstantInt>(OrigLen)) {
+      Ptrs.erase(std::remove_if(Ptrs.begin(), Ptrs.end(),
+                                [&](Value *Ptr) {
+                                  return isTriviallySafe(
+                                      Ptr, CLen->getZExtValue(), DL);
+                                }),
+                 Ptrs.end());
+    }
+    if (Ptrs.empty()) {
+      return;
+    }
+
+    // A failed check clamps the length to zero, so nothing is touched
+    Value *Len = B.CreateZExtOrTrunc(OrigLen, Int64Ty);
+    for (Value *Ptr : Ptrs) {
+      Value *IDVal = ConstantInt::get(Int64Ty, ++CheckID);
+      Len = B.CreateCall(Fn, {B.CreatePointerCast(Ptr, I8PtrTy), Len, IDVal});
+    }
+    // memcpy.inline takes its length as an immediate, so it becomes a plain
+    // memcpy before the clamped length is substituted
+    if (isa<MemCpyInlineInst>(MI)) {
+      MI->setCalledFunction(Intrinsic::getDeclaration(
+          MI->getModule(), Intrinsic::memcpy,
+          {MI->getRawDest()->getType(),
+           cast<MemTransferInst>(MI)->getRawSource()->getType(),
+           OrigLen->getType()}));
+    }
+    MI->setLength(B.CreateZExtOrTrunc(Len, OrigLen->getType()));
+  }
+
+  // Pack guest globals into one object per kind (rodata, data, bss), so a
+  // single assumption in entry covers each kind and every global sits at a
+  // constant offset from it. FLUKE_MERGE_GLOBALS=0 keeps them separate.
+  static void mergeGlobals(Module &M) {
+    const char *EnvStr = std::getenv("FLUKE_MERGE_GLOBALS");
+    if (EnvStr && StringRef(EnvStr) == "0") {
+      return;
+    }
+
+    // llvm.used and llvm.compiler.used may only list globals themselves, so
+    // those stay where they are
+    SmallVector<GlobalValue *, 8> Used;
+    collectUsedGlobalVariables(M, Used, false);
+    collectUsedGlobalVariables(M, Used, true);
+    SmallPtrSet<GlobalValue *, 8> Pinned(Used.begin(), Used.end());
+
+    const DataLayout &DL = M.getDataLayout();
+    SmallVector<GlobalVariable *, 16> Groups[3];
+    for (GlobalVariable &G : M.globals()) {
+      if (G.isDeclaration() || G.getName().startswith("llvm.") ||
+          Pinned.count(&G) ||
+          G.hasSection() || G.isThreadLocal() || G.hasComdat() ||
+          !G.hasExactDefinition() || G.isExternallyInitialized() ||
+          G.getAddressSpace() != 0 ||
+          DL.getTypeAllocSize(G.getValueType()) == 0) {
+        continue;
+      }
+
+      unsigned Kind = G.isConstant()                         ? 0
+                      : G.getInitializer()->isNullValue() ? 2
+                                                             : 1;
+      Groups[Kind].push_back(&G);
+    }
+
+    static const char *const Names[] = {"__fluke_rodata", "__fluke_data",
+                                        "__fluke_bss"};
+    for (unsigned Kind = 0; Kind < 3; Kind++) {
+      if (Groups[Kind].size() > 1) {
+        mergeGroup(M, Groups[Kind], Names[Kind], Kind == 0);
+      }
+    }
+  }
+
+  static void mergeGroup(Module &M, ArrayRef<GlobalVariable *> Globals,
+                         StringRef Name, bool IsConstant) {
+    LLVMContext &Ctx = M.getContext();
+    const DataLayout &DL = M.getDataLayout();
+    Type *Int8Ty = Type::getInt8Ty(Ctx);
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+
+    // Packed layout with explicit padding keeps each global's alignment
+    SmallVector<Type *, 16> Fields;
+    SmallVector<Constant *, 16> Inits;
+    SmallVector<unsigned, 16> FieldIdx;
+    uint64_t Offset = 0;
+    Align MaxAlign(1);
+    for (GlobalVariable *G : Globals) {
+      Align A = DL.getPreferredAlign(G);
+      MaxAlign = std::max(MaxAlign, A);
+
+      uint64_t Start = alignTo(Offset, A);
+      if (Start != Offset) {
+        ArrayType *PadTy = ArrayType::get(Int8Ty, Start - Offset);
+        Fields.push_back(PadTy);
+        Inits.push_back(ConstantAggregateZero::get(PadTy));
+      }
+
+      FieldIdx.push_back(Fields.size());
+      Fields.push_back(G->getValueType());
+      Inits.push_back(G->getInitializer());
+      Offset = Start + DL.getTypeAllocSize(G->getValueType());
+    }
+
+    StructType *STy = StructType::get(Ctx, Fields, true);
+    auto *Merged =
+        new GlobalVariable(M, STy, IsConstant, GlobalValue::InternalLinkage,
+                           ConstantStruct::get(STy, Inits), Name);
+    Merged->setAlignment(MaxAlign);
+
+    for (size_t I = 0; I < Globals.size(); I++) {
+      GlobalVariable *G = Globals[I];
+      Constant *Idx[] = {ConstantInt::get(Int32Ty, 0),
+                         ConstantInt::get(Int32Ty, FieldIdx[I])};
+      Constant *Addr = ConstantExpr::getInBoundsGetElementPtr(STy, Merged, Idx);
+      G->replaceAllUsesWith(Addr);
+
+      // Exported globals keep their symbol as an alias into the segment
+      if (!G->hasLocalLinkage()) {
+        auto *GA = GlobalAlias::create(G->getValueType(), 0, G->getLinkage(),
+                                       "", Addr, &M);
+        GA->takeName(G);
+        GA->setVisibility(G->getVisibility());
+        GA->setDSOLocal(G->isDSOLocal());
+      }
+      G->eraseFromParent();
+    }
+  }
+
   static void instrumentGlobals(Module &M, IRBuilder<> &B,
                                 FunctionCallee &AssumeFn) {
     LLVMContext &Ctx = M.getContext();
@@ -229,6 +621,10 @@ llvmGetPassPluginInfo() {
                     MPM.addPass(BoundsCheckPass());
                     return true;
                   }
+                  if (Name == "bounds-check<write-only>") {
+                    MPM.addPass(BoundsCheckPass(true));
+                    return true;
+                  }
                   return false;
                 });
           }};
@@ -0,0 +1,466 @@
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <cstdlib>
+#include <fstream>
+#include <regex>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+
+// In-process replacement for the per-program Makefile pipeline. Inputs are
+// C sources or LLVM IR; each produces <stem>_lib.so and <stem>_clam.so.
+
+static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore,
+                                    cl::desc("<inputs (.c, .ll, .bc)>"));
+
+static cl::opt<unsigned> Jobs("j", cl::init(1),
+                              cl::desc("Number of programs built in parallel"));
+
+static cl::opt<bool> Trap("trap", cl::init(false),
+                          cl::desc("Link the trapping runtime and emit "
+                                   "_lib_trap.so/_clam_trap.so"));
+
+static cl::opt<bool> WriteOnly("write-only", cl::init(false),
+                               cl::desc("Check stores only and emit "
+                                        "_lib_wo.so/_clam_wo.so"));
+
+static cl::opt<bool>
+    Prelink("prelink", cl::init(false),
+            cl::desc("Call the host through __fluke_imports, which only "
+                     "libfluke.so fills, and emit _lib_prelinked.so/"
+                     "_clam_prelinked.so"));
+
+static cl::opt<bool> NoLib("no-lib", cl::init(false),
+                           cl::desc("Skip the _lib.so variant"));
+
+static cl::opt<bool> NoClam("no-clam", cl::init(false),
+                            cl::desc("Skip the _clam.so variant"));
+
+static cl::opt<std::string> CC("cc", cl::init("clang-14"),
+                               cl::desc("Front end and final linker"));
+
+static cl::opt<std::string> CFlags("cflags",
+                                   cl::init("-O3 -fPIC -Wall -Wextra"),
+                                   cl::desc("Flags for the C front end"));
+
+static cl::opt<std::string> LDFlags("ldflags", cl::init("-shared -Wl,-z,now"),
+                                    cl::desc("Flags for the final link"));
+
+static cl::opt<std::string> RuntimeBC("runtime", cl::init("runtime.bc"),
+                                      cl::desc("Fluke runtime bitcode"));
+
+static cl::opt<std::string> RuntimeTrapBC("runtime-trap",
+                                          cl::init("runtime_trap.bc"),
+                                          cl::desc("Trapping runtime bitcode"));
+
+static cl::opt<std::string> StubsBC("stubs", cl::init("stubs.bc"),
+                                    cl::desc("Crab stub bitcode"));
+
+static cl::opt<std::string> PassPluginPath("pass-plugin",
+                                           cl::init("./bounds_check.so"),
+                                           cl::desc("Bounds check plugin"));
+
+static cl::opt<std::string> PatchPluginPath("patch-plugin",
+                                            cl::init("./patch_entry.so"),
+                                            cl::desc("Entry patch plugin"));
+
+static cl::opt<std::string> ImportPluginPath("import-plugin",
+                                             cl::init("./import_table.so"),
+                                             cl::desc("Import table plugin"));
+
+static cl::opt<std::string> Clam("clam", cl::init("clam/py/clam.py"),
+                                 cl::desc("Clam driver script"));
+
+static cl::opt<std::string>
+    ClamFlags("clam-flags",
+              cl::init("--crab-track=mem --crab-dom=zones "
+                       "--crab-check=assert --crab-inter "
+                       "--crab-opt=add-invariants "
+                       "--crab-opt-invariants-loc=all"),
+              cl::desc("Flags passed to Clam"));
+
+static cl::opt<bool>
+    KeepTemps("keep-temps", cl::init(false),
+              cl::desc("Keep intermediate bitcode beside the input"));
+
+namespace {
+
+struct Toolchain {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> Runtime;
+  std::unique_ptr<Module> Stubs;
+  std::vector<PassPlugin> Plugins;
+  std::unique_ptr<TargetMachine> TM;
+};
+
+} // namespace
+
+static void appendArgs(StringRef Flags, std::vector<std::string> &Args) {
+  SmallVector<StringRef, 8> Parts;
+  Flags.split(Parts, ' ', -1, false);
+  for (StringRef P : Parts) {
+    Args.push_back(P.str());
+  }
+}
+
+static bool runTool(StringRef Tool, StringRef Flags,
+                    std::vector<std::string> Extra,
+                    Optional<StringRef> Log = None) {
+  ErrorOr<std::string> Path = sys::findProgramByName(Tool);
+  if (!Path) {
+    errs() << "fluke-cc: cannot find " << Tool << "\n";
+    return false;
+  }
+
+  std::vector<std::string> Storage{*Path};
+  appendArgs(Flags, Storage);
+  Storage.insert(Storage.end(), Extra.begin(), Extra.end());
+
+  std::vector<StringRef> Args(Storage.begin(), Storage.end());
+  Optional<StringRef> Redirects[] = {None, Log, Log};
+  std::string Err;
+  int RC = sys::ExecuteAndWait(*Path, Args, None,
+                               Log ? ArrayRef<Optional<StringRef>>(Redirects)
+                                   : ArrayRef<Optional<StringRef>>(),
+                               0, 0, &Err);
+  if (RC != 0) {
+    errs() << "fluke-cc: " << Tool << " failed (" << RC << ") " << Err << "\n";
+    return false;
+  }
+  return true;
+}
+
+static std::unique_ptr<Module> loadModule(StringRef Path, LLVMContext &Ctx) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIRFile(Path, Err, Ctx);
+  if (!M) {
+    Err.print("fluke-cc", errs());
+  }
+  return M;
+}
+
+static bool writeBitcode(Module &M, StringRef Path) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "fluke-cc: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  WriteBitcodeToFile(M, OS);
+  return true;
+}
+
+static bool linkInto(Module &Dst, const Module &Src) {
+  if (Linker::linkModules(Dst, CloneModule(Src))) {
+    errs() << "fluke-cc: failed to link " << Src.getModuleIdentifier() << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Run a textual pipeline with the bounds-check, patch-entry and import-table
+// plugins
+static bool runPipeline(Toolchain &TC, Module &M, StringRef Pipeline) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PassBuilder PB(TC.TM.get());
+  for (PassPlugin &P : TC.Plugins) {
+    P.registerPassBuilderCallbacks(PB);
+  }
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (Error E = PB.parsePassPipeline(MPM, Pipeline)) {
+    errs() << "fluke-cc: " << toString(std::move(E)) << "\n";
+    return false;
+  }
+  MPM.run(M, MAM);
+  return true;
+}
+
+// Same as the Makefile's TRAP_OPT_FLAGS, so O3 splits cold code at the same
+// point and places it in the same section as `opt -O3 $(TRAP_OPT_FLAGS)`
+static bool enableTrapOptFlags() {
+  StringMap<cl::Option *> &Opts = cl::getRegisteredOptions();
+  for (const char *Name : {"hot-cold-split", "enable-cold-section"}) {
+    auto It = Opts.find(Name);
+    if (It == Opts.end() || It->second->addOccurrence(0, Name, "true")) {
+      errs() << "fluke-cc: cannot set -" << Name << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool emitObject(Toolchain &TC, Module &M, StringRef Path) {
+  M.setDataLayout(TC.TM->createDataLayout());
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "fluke-cc: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  legacy::PassManager PM;
+  if (TC.TM->addPassesToEmitFile(PM, OS, nullptr, CGFT_ObjectFile)) {
+    errs() << "fluke-cc: target cannot emit object files\n";
+    return false;
+  }
+  PM.run(M);
+  return true;
+}
+
+// Mirror of print_failures.sh and extract_safe_ids.py over a Clam log
+static std::string readVerifiedIDs(StringRef LogPath) {
+  std::ifstream Log(LogPath.str());
+  std::regex SafeRe(R"(id=(\d+)\s+Result:\s+OK)");
+  std::regex CountRe(R"((\d+)\s+Number of total (safe|warning|error) checks)");
+
+  // Like grep -m1, only the first count of each kind is taken
+  std::string Line, IDs;
+  long Safe = -1, Warning = -1, Error = -1;
+  std::smatch Match;
+  while (std::getline(Log, Line)) {
+    if (std::regex_search(Line, Match, SafeRe)) {
+      IDs += (IDs.empty() ? "" : ",") + Match[1].str();
+    } else if (std::regex_search(Line, Match, CountRe)) {
+      long &Count = Match[2] == "safe"      ? Safe
+                    : Match[2] == "warning" ? Warning
+                                            : Error;
+      if (Count < 0) {
+        Count = std::stol(Match[1].str());
+      }
+    }
+  }
+  Safe = std::max(Safe, 0L);
+  long Total = Safe + std::max(Warning, 0L) + std::max(Error, 0L);
+
+  outs() << "FLUKE: verified " << Safe << " / " << Total << " for " << LogPath
+         << "\n";
+  return IDs;
+}
+
+// Stubs, patch-entry, O3, the optional import table, codegen and link for one
+// variant
+static bool finishVariant(Toolchain &TC, std::unique_ptr<Module> M,
+                          StringRef Prefix, StringRef VerifiedIDs) {
+  if (!linkInto(*M, *TC.Stubs)) {
+    return false;
+  }
+
+  setenv("VERIFIED_IDS", VerifiedIDs.str().c_str(), 1);
+  if (!runPipeline(TC, *M, "patch-entry") ||
+      !runPipeline(TC, *M, "default<O3>") ||
+      (Prelink && !runPipeline(TC, *M, "import-table"))) {
+    return false;
+  }
+
+  if (verifyModule(*M, &errs())) {
+    errs() << "fluke-cc: " << Prefix << " failed verification\n";
+    return false;
+  }
+
+  std::string Obj = (Prefix + ".o").str();
+  if (!emitObject(TC, *M, Obj)) {
+    return false;
+  }
+  bool Ok = runTool(CC, CFlags + " " + LDFlags,
+                    {Obj, "-o", (Prefix + ".so").str()});
+  sys::fs::remove(Obj);
+  return Ok;
+}
+
+static bool buildProgram(Toolchain &TC, StringRef Input) {
+  StringRef Ext = sys::path::extension(Input);
+  SmallString<128> Stem(Input);
+  sys::path::replace_extension(Stem, "");
+
+  // Intermediates go to a private directory, so parallel builds of the same
+  // program never share them; --keep-temps leaves them beside the input
+  SmallString<128> TempDir;
+  if (!KeepTemps) {
+    if (std::error_code EC =
+            sys::fs::createUniqueDirectory("fluke-cc", TempDir)) {
+      errs() << "fluke-cc: " << EC.message() << "\n";
+      return false;
+    }
+  }
+  auto Cleanup = make_scope_exit([&] {
+    if (!TempDir.empty()) {
+      sys::fs::remove_directories(TempDir);
+    }
+  });
+  auto Temp = [&](const Twine &Name) {
+    SmallString<128> Path(TempDir.empty() ? Stem : TempDir);
+    if (!TempDir.empty()) {
+      sys::path::append(Path, sys::path::filename(Stem));
+    }
+    return (Path + Name).str();
+  };
+
+  // Only the C front end runs out of process
+  std::string IRPath = Input.str();
+  if (Ext == ".c") {
+    IRPath = Temp(".bc");
+    if (!runTool(CC, CFlags + " -Xclang -disable-O0-optnone -emit-llvm -c",
+                 {Input.str(), "-o", IRPath})) {
+      return false;
+    }
+  }
+
+  std::unique_ptr<Module> M = loadModule(IRPath, TC.Ctx);
+  StringRef Pipeline = WriteOnly ? "bounds-check<write-only>" : "bounds-check";
+  if (!M || !runPipeline(TC, *M, Pipeline) ||
+      !linkInto(*M, *TC.Runtime) || !runPipeline(TC, *M, "always-inline")) {
+    return false;
+  }
+
+  std::string Suffix = std::string(WriteOnly ? "_wo" : "") +
+                       std::string(Trap ? "_trap" : "") +
+                       std::string(Prelink ? "_prelinked" : "");
+  bool Ok = true;
+
+  if (!NoLib) {
+    std::string Prefix = (Stem + "_lib" + Suffix).str();
+    Ok &= finishVariant(TC, CloneModule(*M), Prefix, "");
+  }
+
+  if (!NoClam) {
+    // Clam is an external analyzer, so hand it bitcode on disk
+    std::string Inlined = Temp(Suffix + "_inlined.bc");
+    std::string ClamBC = Temp("_clam" + Suffix + ".bc");
+    // The log stays beside the outputs for print_failures.sh
+    std::string Log = (Stem + "_clam" + Suffix + ".bc.log").str();
+
+    if (!writeBitcode(*M, Inlined) ||
+        !runTool(Clam, ClamFlags, {Inlined, "-o", ClamBC}, StringRef(Log))) {
+      return false;
+    }
+
+    std::unique_ptr<Module> Checked = loadModule(ClamBC, TC.Ctx);
+    if (!Checked) {
+      return false;
+    }
+
+    std::string IDs = readVerifiedIDs(Log);
+    Ok &= finishVariant(TC, std::move(Checked),
+                        (Stem + "_clam" + Suffix).str(), IDs);
+  }
+  return Ok;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "fluke compiler driver\n");
+  if (Trap && !enableTrapOptFlags()) {
+    return 1;
+  }
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  Toolchain TC;
+  std::string Triple = sys::getDefaultTargetTriple();
+  std::string Err;
+  const Target *T = TargetRegistry::lookupTarget(Triple, Err);
+  if (!T) {
+    errs() << "fluke-cc: " << Err << "\n";
+    return 1;
+  }
+  // Generic like the Makefile's clang -O3, so builds do not depend on the
+  // machine that ran them
+  TC.TM.reset(T->createTargetMachine(Triple, "generic", "",
+                                     TargetOptions(), Reloc::PIC_, None,
+                                     CodeGenOpt::Aggressive));
+
+  // Load shared inputs once; workers clone them after fork
+  TC.Runtime = loadModule(Trap ? RuntimeTrapBC : RuntimeBC, TC.Ctx);
+  TC.Stubs = loadModule(StubsBC, TC.Ctx);
+  if (!TC.Runtime || !TC.Stubs) {
+    return 1;
+  }
+
+  std::vector<std::string> PluginPaths{PassPluginPath, PatchPluginPath};
+  if (Prelink) {
+    PluginPaths.push_back(ImportPluginPath);
+  }
+  for (const std::string &Path : PluginPaths) {
+    Expected<PassPlugin> P = PassPlugin::Load(Path);
+    if (!P) {
+      errs() << "fluke-cc: " << toString(P.takeError()) << "\n";
+      return 1;
+    }
+    TC.Plugins.push_back(*P);
+  }
+
+  if (Jobs <= 1) {
+    bool Ok = true;
+    for (const std::string &Input : Inputs) {
+      Ok &= buildProgram(TC, Input);
+    }
+    return Ok ? 0 : 1;
+  }
+
+  // Fork one worker per program so environment-driven passes stay isolated
+  unsigned Running = 0;
+  int Failed = 0;
+  auto Reap = [&]() {
+    int Status;
+    if (wait(&Status) > 0) {
+      Running--;
+      Failed |= !WIFEXITED(Status) || WEXITSTATUS(Status) != 0;
+    }
+  };
+
+  outs().flush();
+  for (const std::string &Input : Inputs) {
+    if (Running >= Jobs) {
+      Reap();
+    }
+
+    pid_t Pid = fork();
+    if (Pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (Pid == 0) {
+      bool Ok = buildProgram(TC, Input);
+      outs().flush();
+      _exit(Ok ? 0 : 1);
+    }
+    Running++;
+  }
+
+  while (Running > 0) {
+    Reap();
+  }
+  return Failed;
+}
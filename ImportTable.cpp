@@ -0,0 +1,150 @@
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <vector>
+
+using namespace llvm;
+
+// Routes every call to a host-provided function through one table the host
+// fills before running constructors; libfluke.so does so for each instance:
+//
+//   __fluke_imports       whole pages of i8* slots in .fluke.imports
+//   __fluke_import_names  NUL-separated names, in slot order
+//   __fluke_import_count  number of names
+//
+// Entries of unresolved weak imports stay null, as with normal binding.
+// Functions whose address escapes into constant data keep their GOT entry.
+
+namespace {
+
+// Functions only used by instructions, directly or through a constant cast,
+// can be rewritten into table loads
+static bool isImportable(Function &F) {
+  if (!F.isDeclaration() || F.isIntrinsic() || F.use_empty()) {
+    return false;
+  }
+  for (User *U : F.users()) {
+    if (isa<Instruction>(U)) {
+      continue;
+    }
+    auto *CE = dyn_cast<ConstantExpr>(U);
+    if (!CE || !CE->isCast()) {
+      return false;
+    }
+    for (User *CU : CE->users()) {
+      if (!isa<Instruction>(CU)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Where a replacement for operand U must be computed
+static Instruction *insertionPoint(Use &U) {
+  auto *I = cast<Instruction>(U.getUser());
+  if (auto *PN = dyn_cast<PHINode>(I)) {
+    return PN->getIncomingBlock(U)->getTerminator();
+  }
+  return I;
+}
+
+class ImportTablePass : public PassInfoMixin<ImportTablePass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+    std::vector<Function *> Imports;
+    for (Function &F : M) {
+      if (isImportable(F)) {
+        Imports.push_back(&F);
+      }
+    }
+    if (Imports.empty()) {
+      return PreservedAnalyses::all();
+    }
+
+    // Whole pages, so the loader can share them without sharing neighbours
+    LLVMContext &Ctx = M.getContext();
+    Type *SlotTy = Type::getInt8PtrTy(Ctx);
+    uint64_t PageSlots = 4096 / M.getDataLayout().getPointerSize();
+    ArrayType *TableTy =
+        ArrayType::get(SlotTy, alignTo(Imports.size(), PageSlots));
+
+    auto *Table = new GlobalVariable(M, TableTy, false,
+                                     GlobalValue::ExternalLinkage,
+                                     ConstantAggregateZero::get(TableTy),
+                                     "__fluke_imports");
+    Table->setSection(".fluke.imports");
+    Table->setAlignment(Align(4096));
+
+    std::string Names;
+    for (Function *F : Imports) {
+      Names += F->getName().str();
+      Names.push_back('\0');
+    }
+    auto *NamesInit = ConstantDataArray::getString(Ctx, Names, false);
+    auto *NameTable = new GlobalVariable(M, NamesInit->getType(), true,
+                                         GlobalValue::ExternalLinkage,
+                                         NamesInit, "__fluke_import_names");
+    NameTable->setSection(".fluke");
+
+    auto *Count = new GlobalVariable(
+        M, Type::getInt32Ty(Ctx), true, GlobalValue::ExternalLinkage,
+        ConstantInt::get(Type::getInt32Ty(Ctx), Imports.size()),
+        "__fluke_import_count");
+    Count->setSection(".fluke");
+
+    appendToUsed(M, {Table, NameTable, Count});
+
+    MDNode *Invariant = MDNode::get(Ctx, {});
+    for (unsigned Idx = 0; Idx < Imports.size(); Idx++) {
+      Function *F = Imports[Idx];
+
+      // Casts of the declaration become instructions, so every use below
+      // is an instruction operand
+      for (User *U : make_early_inc_range(F->users())) {
+        auto *CE = dyn_cast<ConstantExpr>(U);
+        if (!CE) {
+          continue;
+        }
+        for (Use &CU : make_early_inc_range(CE->uses())) {
+          Instruction *Cast = CE->getAsInstruction();
+          Cast->insertBefore(insertionPoint(CU));
+          CU.set(Cast);
+        }
+        CE->destroyConstant();
+      }
+
+      for (Use &U : make_early_inc_range(F->uses())) {
+        IRBuilder<> B(insertionPoint(U));
+        Value *Slot = B.CreateConstInBoundsGEP2_32(TableTy, Table, 0, Idx);
+        LoadInst *Ptr = B.CreateLoad(SlotTy, Slot, F->getName() + ".import");
+        Ptr->setMetadata(LLVMContext::MD_invariant_load, Invariant);
+        U.set(B.CreateBitCast(Ptr, F->getType()));
+      }
+    }
+
+    return PreservedAnalyses::none();
+  }
+};
+
+} // namespace
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "import-table", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "import-table") {
+                    MPM.addPass(ImportTablePass());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
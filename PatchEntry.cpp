@@ -1,7 +1,11 @@
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/ConstantRange.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
@@ -15,11 +19,170 @@ using namespace llvm;
 
 namespace {
 
+// True if control always reaches To once it reaches From
+static bool reaches(Instruction *From, Instruction *To) {
+  if (From == To) {
+    return true;
+  }
+  if (From->getParent() != To->getParent() || !From->comesBefore(To)) {
+    return false;
+  }
+  for (Instruction *I = From; I != To; I = I->getNextNode()) {
+    if (!isGuaranteedToTransferExecutionToSuccessor(I)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// True if To runs on every call of its function
+static bool runsOnEntry(Instruction *To) {
+  BasicBlock &Entry = To->getFunction()->getEntryBlock();
+  if (To->getParent() != &Entry) {
+    return false;
+  }
+  return reaches(&Entry.front(), To);
+}
+
+// Narrow !range on an integer load or call known to satisfy CR
+static void addRange(Instruction *I, const ConstantRange &CR) {
+  ConstantRange Range = CR;
+  if (MDNode *Old = I->getMetadata(LLVMContext::MD_range)) {
+    Range = Range.intersectWith(getConstantRangeFromMetadata(*Old));
+  }
+  if (Range.isFullSet() || Range.isEmptySet()) {
+    return;
+  }
+
+  MDBuilder MDB(I->getContext());
+  I->setMetadata(LLVMContext::MD_range,
+                 MDB.createRange(Range.getLower(), Range.getUpper()));
+}
+
+// Turn an invariant Clam proved at Site into metadata or attributes on the
+// value it constrains, where that value cannot be observed without Site
+// executing afterwards.
+static void materialize(Value *Cond, Instruction *Site) {
+  auto *Cmp = dyn_cast<ICmpInst>(Cond);
+  if (!Cmp) {
+    return;
+  }
+
+  Value *X = Cmp->getOperand(0);
+  auto *C = dyn_cast<Constant>(Cmp->getOperand(1));
+  ICmpInst::Predicate Pred = Cmp->getPredicate();
+  if (!C) {
+    X = Cmp->getOperand(1);
+    C = dyn_cast<Constant>(Cmp->getOperand(0));
+    Pred = Cmp->getSwappedPredicate();
+  }
+  if (!C || isa<Constant>(X)) {
+    return;
+  }
+
+  // Values defined by a terminator, such as an invoke, are only available
+  // in a successor, so nothing ties them to Site
+  auto *I = dyn_cast<Instruction>(X);
+  Instruction *Next = I ? I->getNextNode() : nullptr;
+  bool Holds = I ? Next && reaches(Next, Site) : runsOnEntry(Site);
+
+  if (X->getType()->isPointerTy()) {
+    if (!Holds || Pred != ICmpInst::ICMP_NE || !C->isNullValue()) {
+      return;
+    }
+    if (auto *LI = dyn_cast<LoadInst>(X)) {
+      LI->setMetadata(LLVMContext::MD_nonnull, MDNode::get(X->getContext(), {}));
+    } else if (auto *CB = dyn_cast<CallBase>(X)) {
+      CB->addRetAttr(Attribute::NonNull);
+    } else if (auto *A = dyn_cast<Argument>(X)) {
+      A->addAttr(Attribute::NonNull);
+    }
+    return;
+  }
+
+  auto *CI = dyn_cast<ConstantInt>(C);
+  if (!Holds || !CI || !(isa<LoadInst>(X) || isa<CallBase>(X))) {
+    return;
+  }
+  addRange(cast<Instruction>(X),
+           ConstantRange::makeExactICmpRegion(Pred, CI->getValue()));
+}
+
+// Clam assumes every assertion holds once it has been checked, proven or
+// not, so invariants in a function that runs an unverified check may rest on
+// it. Such functions taint their direct callers, and every indirect call if
+// their address is taken.
+static std::set<Function *>
+taintedFunctions(Module &M, const std::set<Function *> &Unverified) {
+  std::set<Function *> Tainted = Unverified;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    bool IndirectTainted = llvm::any_of(
+        Tainted, [](Function *F) { return F->hasAddressTaken(); });
+    for (Function &F : M) {
+      if (F.isDeclaration() || Tainted.count(&F)) {
+        continue;
+      }
+      bool Taint = false;
+      for (Instruction &I : instructions(F)) {
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (!CB) {
+          continue;
+        }
+        Function *Callee = CB->getCalledFunction();
+        if (Callee ? Tainted.count(Callee) != 0
+                   : IndirectTainted && !CB->isInlineAsm()) {
+          Taint = true;
+          break;
+        }
+      }
+      if (Taint) {
+        Tainted.insert(&F);
+        Changed = true;
+      }
+    }
+  }
+  return Tainted;
+}
+
+// Bracket the exported entry with the runtime's timing hooks. Calls from
+// inside the module, such as main, keep going to the unwrapped body.
+static void wrapEntry(Module &M, Function *EntryFn) {
+  Function *Begin = M.getFunction("__fluke_entry_begin");
+  Function *End = M.getFunction("__fluke_entry_end");
+  if (!Begin || Begin->isDeclaration() || !End || End->isDeclaration()) {
+    return;
+  }
+
+  FunctionType *FTy = EntryFn->getFunctionType();
+  EntryFn->setName("__fluke_entry_body");
+  EntryFn->setLinkage(GlobalValue::InternalLinkage);
+
+  Function *Wrapper = Function::Create(FTy, GlobalValue::ExternalLinkage,
+                                       "entry", M);
+  Wrapper->copyAttributesFrom(EntryFn);
+  Wrapper->setLinkage(GlobalValue::ExternalLinkage);
+  Wrapper->setVisibility(GlobalValue::DefaultVisibility);
+
+  IRBuilder<> B(BasicBlock::Create(M.getContext(), "", Wrapper));
+  Value *Start = B.CreateCall(Begin);
+  SmallVector<Value *, 4> Args;
+  for (Argument &A : Wrapper->args()) {
+    Args.push_back(&A);
+  }
+  CallInst *Ret = B.CreateCall(EntryFn, Args);
+  B.CreateCall(End, {Start});
+  if (FTy->getReturnType()->isVoidTy()) {
+    B.CreateRetVoid();
+  } else {
+    B.CreateRet(Ret);
+  }
+}
+
 class BoundsCheckPass : public PassInfoMixin<BoundsCheckPass> {
 public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
-    LLVMContext &Ctx = M.getContext();
-
     // Promote verified assertions to llvm.assume
     std::set<int> SafeSet;
     const char *EnvStr = std::getenv("VERIFIED_IDS");
@@ -39,6 +202,7 @@ public:
 
     int CheckCounter = 0;
     std::vector<CallInst *> ToPromote;
+    std::set<Function *> Unverified;
 
     for (Function &F : M) {
       for (BasicBlock &BB : F) {
@@ -48,6 +212,8 @@ public:
               CheckCounter++;
               if (HasVerifiedIDs && SafeSet.count(CheckCounter)) {
                 ToPromote.push_back(CI);
+              } else {
+                Unverified.insert(&F);
               }
             }
           }
@@ -68,11 +234,63 @@ public:
       CI->eraseFromParent();
     }
 
+    // Clam's add-invariants optimization leaves its invariants behind as
+    // verifier.assume calls; keep them as assumptions and, where they pin
+    // down a single value, as metadata the optimizer reads directly. Those
+    // in tainted functions are dropped, or the optimizer could use them to
+    // fold away the masks of checks Clam never proved.
+    std::set<Function *> Tainted = taintedFunctions(M, Unverified);
+    std::vector<std::pair<Value *, CallInst *>> Facts;
+    for (StringRef Name : {"verifier.assume", "verifier.assume.not"}) {
+      Function *VerifierAssume = M.getFunction(Name);
+      if (!VerifierAssume) {
+        continue;
+      }
+
+      bool Negate = Name.endswith(".not");
+      for (User *U : make_early_inc_range(VerifierAssume->users())) {
+        auto *CI = dyn_cast<CallInst>(U);
+        if (!CI || CI->arg_size() != 1) {
+          continue;
+        }
+        if (Tainted.count(CI->getFunction())) {
+          CI->eraseFromParent();
+          continue;
+        }
+
+        IRBuilder<> B(CI);
+        Value *Cond = CI->getArgOperand(0);
+        if (!Cond->getType()->isIntegerTy(1)) {
+          Cond = B.CreateICmpNE(Cond, Constant::getNullValue(Cond->getType()));
+        }
+        if (Negate) {
+          auto *Cmp = dyn_cast<ICmpInst>(Cond);
+          Cond = Cmp ? B.CreateICmp(Cmp->getInversePredicate(),
+                                    Cmp->getOperand(0), Cmp->getOperand(1))
+                     : B.CreateNot(Cond);
+        }
+
+        Facts.push_back({Cond, B.CreateCall(LlvmAssume, {Cond})});
+        CI->eraseFromParent();
+      }
+
+      if (VerifierAssume->use_empty()) {
+        VerifierAssume->eraseFromParent();
+      }
+    }
+
+    // Only once every call is an llvm.assume can we tell what runs between
+    // a value and the invariant about it
+    for (auto &Fact : Facts) {
+      materialize(Fact.first, Fact.second);
+    }
+
     // Reset entry function visibility
     Function *EntryFn = M.getFunction("entry");
     if (EntryFn && !EntryFn->isDeclaration()) {
       EntryFn->setLinkage(GlobalValue::ExternalLinkage);
       EntryFn->setVisibility(GlobalValue::DefaultVisibility);
+      wrapEntry(M, EntryFn);
     }
 
     return PreservedAnalyses::none();
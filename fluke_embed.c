@@ -0,0 +1,1520 @@
+// In-process host for fluke guests; see fluke_embed.h.
+//
+// Each instance gets one reservation laid out as
+//
+//   [image][guard][stack][heap ...... committed | reserved]
+//   base                             process_limit        process_limit_max
+//
+// Guest imports bind to host libraries, except the symbols below that must
+// act on the calling instance: its bounds, its heap and the loader
+// hostcalls. Those find the instance through fluke_current.
+
+#define _GNU_SOURCE
+#include "fluke_embed.h"
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef __x86_64__
+#error "fluke_embed only supports x86-64 guests"
+#endif
+
+#define FLUKE_PAGE_SIZE 4096
+#define FLUKE_REGION_SIZE (4L << 30)
+#define FLUKE_HUGE_PAGE_SIZE (2L << 20)
+#define FLUKE_STACK_SIZE (8L << 20)
+#define FLUKE_COMMIT_STEP (1L << 20)
+#define FLUKE_HEAP_GRANULE 32
+#define FLUKE_SIZE_CLASSES 48
+#define FLUKE_MAX_NEEDED 16
+#define FLUKE_MAX_ATEXIT 32
+#define FLUKE_STATS_SLOTS 256
+#define FLUKE_MAX_THREADS 64
+#define FLUKE_THUNK_SIZE 32
+
+static long page_down(long x) { return x & ~(long)(FLUKE_PAGE_SIZE - 1); }
+static long page_up(long x) { return page_down(x + FLUKE_PAGE_SIZE - 1); }
+
+// How an import binds
+enum fluke_bind {
+  BIND_UNDEF, // unresolved weak import
+  BIND_GUEST, // value is an offset into the image
+  BIND_HOST,  // value is a host address
+  BIND_BASE,  // the instance's process_base, process_limit, ...
+  BIND_LIMIT,
+  BIND_LIMIT_MAX,
+  BIND_STATS,
+};
+
+struct fluke_symbol {
+  enum fluke_bind bind;
+  long value;
+};
+
+struct fluke_range {
+  long start;
+  long end;
+};
+
+struct fluke_module {
+  char *file;
+  long file_size;
+  long image_size;
+  Elf64_Phdr *phdrs;
+  int phnum;
+  struct fluke_range relro;
+
+  Elf64_Sym *dynsym;
+  const char *dynstr;
+  long nsyms;
+  struct fluke_symbol *syms;
+  // Entries of the import-table variant's __fluke_imports, bound at load
+  long imports_table;
+  long nimports;
+  struct fluke_symbol *imports;
+
+  Elf64_Rela *rela[2];
+  long nrela[2];
+
+  long init, fini;
+  long init_array, init_count;
+  long fini_array, fini_count;
+
+  long fixed_base, fixed_limit;
+  int growable;
+  void *needed[FLUKE_MAX_NEEDED];
+  int nneeded;
+};
+
+struct fluke_instance {
+  fluke_module *m;
+  char *base;
+  long size;
+
+  // Bound to the guest's process_base, process_limit and process_limit_max
+  const void *base_var;
+  const void *limit_var;
+  const void *limit_max_var;
+  // A slot of the process's stats segment, or own_stats without one
+  struct fluke_stats *stats;
+  struct fluke_stats own_stats;
+  // Counting thunks for host calls: one per dynamic symbol, then one per
+  // import-table entry
+  unsigned char *thunks;
+  long thunks_size;
+
+  char *stack_top;
+  char *heap_start;
+  char *heap_bump;
+  // One entry per heap granule, in host memory the guest cannot reach
+  unsigned *heap_meta;
+  long heap_meta_size;
+  unsigned free_lists[FLUKE_SIZE_CLASSES];
+  pthread_mutex_t heap_lock;
+
+  // State captured after the constructors ran
+  char **data_snapshots;
+  char *heap_snapshot;
+  char *heap_snapshot_bump;
+  unsigned *meta_snapshot;
+  unsigned free_snapshot[FLUKE_SIZE_CLASSES];
+
+  // Guest threads; the tids handed to the guest index this table
+  struct {
+    pthread_t thread;
+    int state; // 0 free, 1 running, 2 being joined
+  } threads[FLUKE_MAX_THREADS];
+  pthread_mutex_t thread_lock;
+
+  struct {
+    void (*fn)(void *);
+    void *arg;
+  } atexit[FLUKE_MAX_ATEXIT];
+  int natexit;
+  int natexit_snapshot;
+
+  jmp_buf trap;
+  int dead;
+  long exit_status;
+};
+
+static __thread fluke_instance *fluke_current;
+static __thread int fluke_in_call;
+// Where a guest thread goes when it exits or traps, and what it returns
+static __thread jmp_buf *fluke_thread_exit;
+static __thread void *fluke_thread_ret;
+
+// Runs fn(args[0..5]) with the stack pointer at top. rbx keeps args across
+// the switch and rbp the caller's stack, so a trap can longjmp straight out.
+long fluke_call_on_stack(char *top, void *fn, const long *args);
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".type fluke_call_on_stack, @function\n"
+        "fluke_call_on_stack:\n"
+        "  push %rbp\n"
+        "  mov %rsp, %rbp\n"
+        "  push %rbx\n"
+        "  mov %rdi, %rsp\n"
+        "  mov %rsi, %rax\n"
+        "  mov %rdx, %rbx\n"
+        "  mov 0(%rbx), %rdi\n"
+        "  mov 8(%rbx), %rsi\n"
+        "  mov 16(%rbx), %rdx\n"
+        "  mov 24(%rbx), %rcx\n"
+        "  mov 32(%rbx), %r8\n"
+        "  mov 40(%rbx), %r9\n"
+        "  call *%rax\n"
+        "  lea -8(%rbp), %rsp\n"
+        "  pop %rbx\n"
+        "  pop %rbp\n"
+        "  ret\n"
+        ".size fluke_call_on_stack, .-fluke_call_on_stack\n");
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+//===----------------------------------------------------------------------===//
+// Guest heap
+//===----------------------------------------------------------------------===//
+
+// Blocks are power-of-two classes carved from a bump pointer, so every block
+// and every pointer handed out starts on a granule. All bookkeeping lives in
+// heap_meta, never in the heap itself, so nothing the guest writes can steer
+// the host. An entry is one of
+//
+//   0                        no block or pointer starts here
+//   META_LIVE | offset | cls a pointer handed out, offset granules past its
+//                            block of class cls
+//   META_FREE | next         a free block, next is the following free block's
+//                            granule + 1, or 0
+#define META_LIVE (1u << 31)
+#define META_FREE (1u << 30)
+#define META_CLS_BITS 6
+#define META_MAX_OFFSET ((1u << 24) - 1)
+
+// Commits more of the reservation and publishes the new limit
+static int commit_to(fluke_instance *inst, char *end) {
+  char *limit = (char *)inst->limit_var;
+  if (end <= limit) {
+    return 0;
+  }
+
+  char *target = limit + FLUKE_COMMIT_STEP;
+  target = end > target ? end : target;
+  target = (char *)page_up((long)target);
+  if (target > inst->base + inst->size) {
+    target = inst->base + inst->size;
+    if (end > target) {
+      return ENOMEM;
+    }
+  }
+  if (mprotect(limit, target - limit, PROT_READ | PROT_WRITE) < 0) {
+    return errno;
+  }
+
+  __atomic_store_n(&inst->limit_var, target, __ATOMIC_RELEASE);
+  return 0;
+}
+
+// heap_bytes reports how far the heap extends, whatever is committed
+static void set_heap_bump(fluke_instance *inst, char *bump) {
+  inst->heap_bump = bump;
+  __atomic_store_n(&inst->stats->heap_bytes, bump - inst->heap_start,
+                   __ATOMIC_RELAXED);
+}
+
+static unsigned granule_of(fluke_instance *inst, const void *p) {
+  return ((const char *)p - inst->heap_start) / FLUKE_HEAP_GRANULE;
+}
+
+static char *granule_addr(fluke_instance *inst, unsigned g) {
+  return inst->heap_start + (long)g * FLUKE_HEAP_GRANULE;
+}
+
+// Returns the start of a block of class cls, with no entry of its own
+static char *heap_alloc_locked(fluke_instance *inst, unsigned cls) {
+  unsigned head = inst->free_lists[cls];
+  if (head) {
+    unsigned *e = &inst->heap_meta[head - 1];
+    inst->free_lists[cls] = *e & ~META_FREE;
+    *e = 0;
+    return granule_addr(inst, head - 1);
+  }
+
+  char *b = inst->heap_bump;
+  if (commit_to(inst, b + (1UL << cls))) {
+    return NULL;
+  }
+  set_heap_bump(inst, b + (1UL << cls));
+  return b;
+}
+
+static void *heap_alloc(fluke_instance *inst, size_t size, size_t align) {
+  if (align & (align - 1)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  align = align > FLUKE_HEAP_GRANULE ? align : 0;
+  if (size > (1UL << 40) ||
+      align > (size_t)META_MAX_OFFSET * FLUKE_HEAP_GRANULE) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  unsigned cls = 5;
+  while ((1UL << cls) < size + align) {
+    cls++;
+  }
+
+  pthread_mutex_lock(&inst->heap_lock);
+  char *p = heap_alloc_locked(inst, cls);
+  if (p) {
+    char *aligned = align ? (char *)(((unsigned long)p + align - 1) &
+                                     ~(unsigned long)(align - 1))
+                          : p;
+    unsigned offset = (aligned - p) / FLUKE_HEAP_GRANULE;
+    inst->heap_meta[granule_of(inst, aligned)] =
+        META_LIVE | offset << META_CLS_BITS | cls;
+    p = aligned;
+  }
+  pthread_mutex_unlock(&inst->heap_lock);
+
+  if (!p) {
+    errno = ENOMEM;
+  }
+  return p;
+}
+
+// The entry of a pointer the guest got from the heap, or 0 if p is anything
+// else: outside the heap, misaligned, freed or never handed out
+static unsigned live_entry(fluke_instance *inst, const void *p) {
+  const char *c = p;
+  if (c < inst->heap_start || c >= inst->heap_bump ||
+      (c - inst->heap_start) % FLUKE_HEAP_GRANULE) {
+    return 0;
+  }
+  unsigned e = inst->heap_meta[granule_of(inst, p)];
+  return e & META_LIVE ? e : 0;
+}
+
+static unsigned entry_cls(unsigned e) {
+  return e & ((1u << META_CLS_BITS) - 1);
+}
+
+static unsigned entry_offset(unsigned e) {
+  return (e & ~META_LIVE) >> META_CLS_BITS;
+}
+
+static size_t usable_size(unsigned e) {
+  return (1UL << entry_cls(e)) - (size_t)entry_offset(e) * FLUKE_HEAP_GRANULE;
+}
+
+// Returns 0 if p was not a live heap pointer
+static int heap_free(fluke_instance *inst, void *p) {
+  pthread_mutex_lock(&inst->heap_lock);
+  unsigned e = live_entry(inst, p);
+  if (e) {
+    unsigned g = granule_of(inst, p);
+    unsigned start = g - entry_offset(e);
+    inst->heap_meta[g] = 0;
+    inst->heap_meta[start] = META_FREE | inst->free_lists[entry_cls(e)];
+    inst->free_lists[entry_cls(e)] = start + 1;
+  }
+  pthread_mutex_unlock(&inst->heap_lock);
+  return e != 0;
+}
+
+static __attribute__((noreturn)) void guest_trap(long id);
+static int in_region(fluke_instance *inst, const void *p, long size);
+
+// Guest allocations resolve to these instead of the host allocator. Every
+// block the guest may free comes from its heap, so other pointers are never
+// handed to the host: free ignores them and realloc treats them as a
+// violation.
+static void *guest_malloc(size_t size) {
+  return heap_alloc(fluke_current, size, 0);
+}
+
+static void guest_free(void *p) {
+  if (p && fluke_current) {
+    heap_free(fluke_current, p);
+  }
+}
+
+static void *guest_calloc(size_t n, size_t size) {
+  size_t total;
+  if (__builtin_mul_overflow(n, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  void *p = guest_malloc(total);
+  if (p) {
+    memset(p, 0, total);
+  }
+  return p;
+}
+
+static void *guest_realloc(void *p, size_t size) {
+  if (!p) {
+    return guest_malloc(size);
+  }
+  pthread_mutex_lock(&fluke_current->heap_lock);
+  unsigned e = live_entry(fluke_current, p);
+  pthread_mutex_unlock(&fluke_current->heap_lock);
+  if (!e) {
+    guest_trap(-1);
+  }
+
+  size_t old = usable_size(e);
+  if (size <= old) {
+    return p;
+  }
+  void *q = guest_malloc(size);
+  if (q) {
+    memcpy(q, p, old);
+    heap_free(fluke_current, p);
+  }
+  return q;
+}
+
+static void *guest_aligned_alloc(size_t align, size_t size) {
+  return heap_alloc(fluke_current, size, align);
+}
+
+static void *guest_memalign(size_t align, size_t size) {
+  return heap_alloc(fluke_current, size, align);
+}
+
+static void *guest_valloc(size_t size) {
+  return heap_alloc(fluke_current, size, FLUKE_PAGE_SIZE);
+}
+
+static int guest_posix_memalign(void **out, size_t align, size_t size) {
+  if (align < sizeof(void *) || !in_region(fluke_current, out, sizeof(*out))) {
+    return EINVAL;
+  }
+  void *p = heap_alloc(fluke_current, size, align);
+  if (!p) {
+    return errno;
+  }
+  *out = p;
+  return 0;
+}
+
+static size_t guest_malloc_usable_size(void *p) {
+  pthread_mutex_lock(&fluke_current->heap_lock);
+  unsigned e = p ? live_entry(fluke_current, p) : 0;
+  pthread_mutex_unlock(&fluke_current->heap_lock);
+  return e ? usable_size(e) : 0;
+}
+
+static char *guest_strndup(const char *s, size_t n) {
+  size_t len = strnlen(s, n);
+  char *p = guest_malloc(len + 1);
+  if (p) {
+    memcpy(p, s, len);
+    p[len] = '\0';
+  }
+  return p;
+}
+
+static char *guest_strdup(const char *s) { return guest_strndup(s, -1); }
+
+//===----------------------------------------------------------------------===//
+// Hostcalls
+//===----------------------------------------------------------------------===//
+
+// True if [p, p + size) lies in the instance's committed memory. Hostcalls
+// check every guest pointer they write through.
+static int in_region(fluke_instance *inst, const void *p, long size) {
+  const char *c = p;
+  const char *limit = __atomic_load_n(&inst->limit_var, __ATOMIC_ACQUIRE);
+  return c >= inst->base && c <= limit && size >= 0 && size <= limit - c;
+}
+
+// A violation or exit() ends the current call; on a guest thread it ends
+// the thread instead
+static __attribute__((noreturn)) void leave_guest(long status) {
+  fluke_instance *inst = fluke_current;
+  inst->dead = 1;
+  inst->exit_status = status;
+  if (fluke_in_call) {
+    longjmp(inst->trap, 1);
+  }
+  fluke_thread_ret = NULL;
+  longjmp(*fluke_thread_exit, 1);
+}
+
+static __attribute__((noreturn)) void guest_trap(long id) {
+  (void)id;
+  __atomic_fetch_add(&fluke_current->stats->violations, 1, __ATOMIC_RELAXED);
+  leave_guest(-1);
+}
+
+static __attribute__((noreturn)) void guest_exit(int status) {
+  leave_guest(status & 0xff);
+}
+
+// Carves the range from the top of the heap, so later heap blocks never
+// overlap an arena the guest grew for itself
+static void *guest_memory_grow(long bytes) {
+  fluke_instance *inst = fluke_current;
+  pthread_mutex_lock(&inst->heap_lock);
+  char *start = (char *)page_up((long)inst->heap_bump);
+  int err = bytes > 0 && bytes <= inst->base + inst->size - start
+                ? commit_to(inst, start + bytes)
+                : ENOMEM;
+  if (!err) {
+    set_heap_bump(inst, (char *)page_up((long)(start + bytes)));
+  }
+  pthread_mutex_unlock(&inst->heap_lock);
+  return err ? NULL : start;
+}
+
+struct fluke_thread_start {
+  fluke_instance *inst;
+  char *stack_top;
+  void *(*start)(void *);
+  void *arg;
+};
+
+// Guest threads are ordinary host threads, so glibc keeps their descriptor
+// and TLS in host memory; only the guest code runs on the sandbox stack
+static void *thread_main(void *p) {
+  struct fluke_thread_start s = *(struct fluke_thread_start *)p;
+  free(p);
+  fluke_current = s.inst;
+
+  jmp_buf exit_to;
+  fluke_thread_exit = &exit_to;
+  long args[FLUKE_MAX_ARGS] = {(long)s.arg};
+  if (setjmp(exit_to) == 0) {
+    return (void *)fluke_call_on_stack(s.stack_top, (void *)s.start, args);
+  }
+  return fluke_thread_ret;
+}
+
+static int guest_thread_create(unsigned long *tid, void *stack, long size,
+                               void *(*start)(void *), void *arg) {
+  fluke_instance *inst = fluke_current;
+  if (!in_region(inst, tid, sizeof(*tid)) || !in_region(inst, stack, size) ||
+      size < FLUKE_PAGE_SIZE) {
+    return EINVAL;
+  }
+
+  struct fluke_thread_start *s = malloc(sizeof(*s));
+  if (!s) {
+    return EAGAIN;
+  }
+  s->inst = inst;
+  s->stack_top = (char *)(((unsigned long)stack + size) & ~15UL);
+  s->start = start;
+  s->arg = arg;
+
+  pthread_mutex_lock(&inst->thread_lock);
+  int slot = 0;
+  while (slot < FLUKE_MAX_THREADS && inst->threads[slot].state) {
+    slot++;
+  }
+  int err = slot < FLUKE_MAX_THREADS
+                ? pthread_create(&inst->threads[slot].thread, NULL,
+                                 thread_main, s)
+                : EAGAIN;
+  if (!err) {
+    inst->threads[slot].state = 1;
+  }
+  pthread_mutex_unlock(&inst->thread_lock);
+
+  if (err) {
+    free(s);
+    return err;
+  }
+  *tid = slot + 1;
+  return 0;
+}
+
+static int guest_thread_join(unsigned long tid, void **ret) {
+  fluke_instance *inst = fluke_current;
+  if (ret && !in_region(inst, ret, sizeof(*ret))) {
+    return EINVAL;
+  }
+
+  pthread_mutex_lock(&inst->thread_lock);
+  int ok = tid >= 1 && tid <= FLUKE_MAX_THREADS &&
+           inst->threads[tid - 1].state == 1;
+  if (ok) {
+    inst->threads[tid - 1].state = 2;
+  }
+  pthread_mutex_unlock(&inst->thread_lock);
+  if (!ok) {
+    return ESRCH;
+  }
+
+  void *r;
+  int err = pthread_join(inst->threads[tid - 1].thread, &r);
+  pthread_mutex_lock(&inst->thread_lock);
+  inst->threads[tid - 1].state = err ? 1 : 0;
+  pthread_mutex_unlock(&inst->thread_lock);
+  if (!err && ret) {
+    *ret = r;
+  }
+  return err;
+}
+
+// On a guest thread this ends just that thread; in a call it ends the call
+static __attribute__((noreturn)) void guest_pthread_exit(void *ret) {
+  if (fluke_in_call) {
+    leave_guest(0);
+  }
+  fluke_thread_ret = ret;
+  longjmp(*fluke_thread_exit, 1);
+}
+
+// Handlers run when the instance is destroyed, not when the host exits
+static int guest_cxa_atexit(void (*fn)(void *), void *arg, void *dso) {
+  (void)dso;
+  fluke_instance *inst = fluke_current;
+  if (inst->natexit == FLUKE_MAX_ATEXIT) {
+    return -1;
+  }
+  inst->atexit[inst->natexit].fn = fn;
+  inst->atexit[inst->natexit].arg = arg;
+  inst->natexit++;
+  return 0;
+}
+
+static int guest_atexit(void (*fn)(void)) {
+  return guest_cxa_atexit((void (*)(void *))fn, NULL, NULL);
+}
+
+static void guest_cxa_finalize(void *dso) { (void)dso; }
+
+static const struct {
+  const char *name;
+  enum fluke_bind bind;
+  void *addr;
+} builtins[] = {
+    {"process_base", BIND_BASE, NULL},
+    {"process_limit", BIND_LIMIT, NULL},
+    {"process_limit_max", BIND_LIMIT_MAX, NULL},
+    {"__fluke_stats", BIND_STATS, NULL},
+    {"__fluke_trap", BIND_HOST, (void *)guest_trap},
+    {"__fluke_memory_grow", BIND_HOST, (void *)guest_memory_grow},
+    {"__fluke_thread_create", BIND_HOST, (void *)guest_thread_create},
+    {"__fluke_thread_join", BIND_HOST, (void *)guest_thread_join},
+    {"pthread_exit", BIND_HOST, (void *)guest_pthread_exit},
+    {"malloc", BIND_HOST, (void *)guest_malloc},
+    {"free", BIND_HOST, (void *)guest_free},
+    {"calloc", BIND_HOST, (void *)guest_calloc},
+    {"realloc", BIND_HOST, (void *)guest_realloc},
+    {"aligned_alloc", BIND_HOST, (void *)guest_aligned_alloc},
+    {"memalign", BIND_HOST, (void *)guest_memalign},
+    {"valloc", BIND_HOST, (void *)guest_valloc},
+    {"posix_memalign", BIND_HOST, (void *)guest_posix_memalign},
+    {"malloc_usable_size", BIND_HOST, (void *)guest_malloc_usable_size},
+    {"strdup", BIND_HOST, (void *)guest_strdup},
+    {"strndup", BIND_HOST, (void *)guest_strndup},
+    {"exit", BIND_HOST, (void *)guest_exit},
+    {"_exit", BIND_HOST, (void *)guest_exit},
+    {"atexit", BIND_HOST, (void *)guest_atexit},
+    {"__cxa_atexit", BIND_HOST, (void *)guest_cxa_atexit},
+    {"__cxa_finalize", BIND_HOST, (void *)guest_cxa_finalize},
+};
+
+//===----------------------------------------------------------------------===//
+// Modules
+//===----------------------------------------------------------------------===//
+
+// File bytes backing [vaddr, vaddr + size), or NULL if they are not all
+// present in one segment
+static void *file_at(const fluke_module *m, long vaddr, long size) {
+  for (int i = 0; i < m->phnum; i++) {
+    const Elf64_Phdr *ph = &m->phdrs[i];
+    if (ph->p_type == PT_LOAD && vaddr >= (long)ph->p_vaddr &&
+        size >= 0 && vaddr + size <= (long)(ph->p_vaddr + ph->p_filesz)) {
+      return m->file + ph->p_offset + (vaddr - ph->p_vaddr);
+    }
+  }
+  return NULL;
+}
+
+static int load_error(fluke_module *m, const char *path, const char *what,
+                      int err) {
+  fprintf(stderr, "fluke: %s: %s\n", path, what);
+  fluke_module_free(m);
+  errno = err;
+  return err;
+}
+
+static int read_file(fluke_module *m, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return errno;
+  }
+  m->file_size = st.st_size;
+  m->file = malloc(st.st_size ? st.st_size : 1);
+  if (!m->file) {
+    close(fd);
+    return ENOMEM;
+  }
+
+  long done = 0;
+  while (done < m->file_size) {
+    ssize_t n = read(fd, m->file + done, m->file_size - done);
+    if (n <= 0) {
+      close(fd);
+      return n < 0 ? errno : EIO;
+    }
+    done += n;
+  }
+  close(fd);
+  return 0;
+}
+
+// Symbol index of a defined global, or -1
+static long find_symbol(const fluke_module *m, const char *name) {
+  for (long i = 1; i < m->nsyms; i++) {
+    const Elf64_Sym *s = &m->dynsym[i];
+    if (s->st_shndx != SHN_UNDEF && ELF64_ST_BIND(s->st_info) != STB_LOCAL &&
+        strcmp(m->dynstr + s->st_name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static long read_long_symbol(const fluke_module *m, const char *name) {
+  long i = find_symbol(m, name);
+  long *p = i < 0 ? NULL : file_at(m, m->dynsym[i].st_value, sizeof(long));
+  return p ? *p : 0;
+}
+
+// bounds-check records the accesses it instrumented in __fluke_policy: 0 for
+// loads and stores, 1 for stores only. Hosts accept write-only builds with
+// FLUKE_POLICY=write-only; anything else requires read-write checks.
+static const char *check_policy(const fluke_module *m) {
+  long i = find_symbol(m, "__fluke_policy");
+  const int *policy =
+      i < 0 ? NULL : file_at(m, m->dynsym[i].st_value, sizeof(int));
+  if (!policy) {
+    return "not built by bounds-check (no __fluke_policy)";
+  }
+
+  const char *want = getenv("FLUKE_POLICY");
+  int write_only = want && strcmp(want, "write-only") == 0;
+  if (*policy == 0 || (*policy == 1 && write_only)) {
+    return NULL;
+  }
+  return *policy == 1 ? "write-only build, but FLUKE_POLICY is read-write"
+                      : "unknown isolation policy";
+}
+
+// Binds an import by name: per-instance builtins first, then the guest's
+// DT_NEEDED libraries, then everything already loaded into the host
+static void resolve_import(const fluke_module *m, const char *name,
+                           struct fluke_symbol *out) {
+  out->bind = BIND_UNDEF;
+  out->value = 0;
+  for (size_t b = 0; b < sizeof(builtins) / sizeof(builtins[0]); b++) {
+    if (strcmp(builtins[b].name, name) == 0) {
+      out->bind = builtins[b].bind;
+      out->value = (long)builtins[b].addr;
+      return;
+    }
+  }
+
+  void *addr = NULL;
+  for (int n = 0; !addr && n < m->nneeded; n++) {
+    addr = dlsym(m->needed[n], name);
+  }
+  if (!addr && *name) {
+    addr = dlsym(RTLD_DEFAULT, name);
+  }
+  if (addr) {
+    out->bind = BIND_HOST;
+    out->value = (long)addr;
+  }
+}
+
+// Defined symbols bind to the guest itself, so a guest can never reach a
+// host definition by exporting the same name
+static int bind_symbols(fluke_module *m) {
+  m->syms = calloc(m->nsyms, sizeof(*m->syms));
+  if (!m->syms) {
+    return ENOMEM;
+  }
+
+  for (long i = 1; i < m->nsyms; i++) {
+    const Elf64_Sym *s = &m->dynsym[i];
+    const char *name = m->dynstr + s->st_name;
+    if (s->st_shndx != SHN_UNDEF) {
+      m->syms[i].bind = BIND_GUEST;
+      m->syms[i].value = s->st_value;
+      continue;
+    }
+
+    resolve_import(m, name, &m->syms[i]);
+    if (m->syms[i].bind == BIND_UNDEF && *name &&
+        ELF64_ST_BIND(s->st_info) != STB_WEAK) {
+      fprintf(stderr, "fluke: undefined symbol %s\n", name);
+      return ENOENT;
+    }
+  }
+  return 0;
+}
+
+// Entries of the table import-table routes host calls through have no
+// dynamic symbols left, so they are bound by name with the same rules, once
+// per module
+static int bind_import_table(fluke_module *m) {
+  long table = find_symbol(m, "__fluke_imports");
+  long names = find_symbol(m, "__fluke_import_names");
+  long count = find_symbol(m, "__fluke_import_count");
+  if (table < 0 || names < 0 || count < 0) {
+    return 0;
+  }
+
+  const char *name =
+      file_at(m, m->dynsym[names].st_value, m->dynsym[names].st_size);
+  const int *n = file_at(m, m->dynsym[count].st_value, sizeof(int));
+  long capacity = m->dynsym[table].st_size / sizeof(void *);
+  if (!name || !n || m->dynsym[table].st_value + capacity * sizeof(void *) >
+                         (unsigned long)m->image_size) {
+    return ENOEXEC;
+  }
+  const char *end = name + m->dynsym[names].st_size;
+
+  m->imports_table = m->dynsym[table].st_value;
+  m->imports = calloc(capacity ? capacity : 1, sizeof(*m->imports));
+  if (!m->imports) {
+    return ENOMEM;
+  }
+  for (long i = 0; i < *n && i < capacity && name < end; i++) {
+    resolve_import(m, name, &m->imports[i]);
+    m->nimports = i + 1;
+    name += strnlen(name, end - name) + 1;
+  }
+  return 0;
+}
+
+fluke_module *fluke_module_load(const char *path) {
+  fluke_module *m = calloc(1, sizeof(*m));
+  if (!m) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  int err = read_file(m, path);
+  if (err) {
+    load_error(m, path, strerror(err), err);
+    return NULL;
+  }
+
+  Elf64_Ehdr *eh = (Elf64_Ehdr *)m->file;
+  if (m->file_size < (long)sizeof(*eh) ||
+      memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_type != ET_DYN ||
+      eh->e_machine != EM_X86_64 ||
+      eh->e_phoff + (long)eh->e_phnum * sizeof(Elf64_Phdr) >
+          (unsigned long)m->file_size) {
+    load_error(m, path, "not an x86-64 shared object", ENOEXEC);
+    return NULL;
+  }
+  m->phdrs = (Elf64_Phdr *)(m->file + eh->e_phoff);
+  m->phnum = eh->e_phnum;
+
+  Elf64_Dyn *dyn = NULL;
+  for (int i = 0; i < m->phnum; i++) {
+    Elf64_Phdr *ph = &m->phdrs[i];
+    if (ph->p_type == PT_LOAD) {
+      if (ph->p_offset + ph->p_filesz > (unsigned long)m->file_size ||
+          ph->p_filesz > ph->p_memsz) {
+        load_error(m, path, "truncated segment", ENOEXEC);
+        return NULL;
+      }
+      long end = page_up(ph->p_vaddr + ph->p_memsz);
+      m->image_size = end > m->image_size ? end : m->image_size;
+    } else if (ph->p_type == PT_DYNAMIC) {
+      dyn = file_at(m, ph->p_vaddr, ph->p_filesz);
+    } else if (ph->p_type == PT_GNU_RELRO) {
+      m->relro.start = page_down(ph->p_vaddr);
+      m->relro.end = page_down(ph->p_vaddr + ph->p_memsz);
+    } else if (ph->p_type == PT_TLS) {
+      load_error(m, path, "thread-local storage is not supported", ENOTSUP);
+      return NULL;
+    }
+  }
+  if (!dyn) {
+    load_error(m, path, "no dynamic section", ENOEXEC);
+    return NULL;
+  }
+
+  long symtab = 0, strtab = 0, strsz = 0, pltrel = DT_RELA;
+  long needed[FLUKE_MAX_NEEDED];
+  for (; dyn->d_tag != DT_NULL; dyn++) {
+    long v = dyn->d_un.d_val;
+    switch (dyn->d_tag) {
+    case DT_SYMTAB: symtab = v; break;
+    case DT_STRTAB: strtab = v; break;
+    case DT_STRSZ: strsz = v; break;
+    case DT_RELA: m->rela[0] = (Elf64_Rela *)v; break;
+    case DT_RELASZ: m->nrela[0] = v / sizeof(Elf64_Rela); break;
+    case DT_JMPREL: m->rela[1] = (Elf64_Rela *)v; break;
+    case DT_PLTRELSZ: m->nrela[1] = v / sizeof(Elf64_Rela); break;
+    case DT_PLTREL: pltrel = v; break;
+    case DT_INIT: m->init = v; break;
+    case DT_FINI: m->fini = v; break;
+    case DT_INIT_ARRAY: m->init_array = v; break;
+    case DT_INIT_ARRAYSZ: m->init_count = v / sizeof(long); break;
+    case DT_FINI_ARRAY: m->fini_array = v; break;
+    case DT_FINI_ARRAYSZ: m->fini_count = v / sizeof(long); break;
+    case DT_NEEDED:
+      if (m->nneeded < FLUKE_MAX_NEEDED) {
+        needed[m->nneeded++] = v;
+      }
+      break;
+    }
+  }
+
+  // The symbol count comes from the section headers, as DT_HASH may be absent
+  for (int i = 0; i < eh->e_shnum && eh->e_shoff; i++) {
+    Elf64_Shdr *sh = (Elf64_Shdr *)(m->file + eh->e_shoff) + i;
+    if ((char *)(sh + 1) <= m->file + m->file_size &&
+        sh->sh_type == SHT_DYNSYM && sh->sh_entsize) {
+      m->nsyms = sh->sh_size / sh->sh_entsize;
+    }
+  }
+
+  m->dynsym = file_at(m, symtab, m->nsyms * sizeof(Elf64_Sym));
+  m->dynstr = file_at(m, strtab, strsz);
+  for (int i = 0; i < 2; i++) {
+    m->rela[i] = m->nrela[i] ? file_at(m, (long)m->rela[i],
+                                       m->nrela[i] * sizeof(Elf64_Rela))
+                             : NULL;
+    if (m->nrela[i] && !m->rela[i]) {
+      load_error(m, path, "bad relocation table", ENOEXEC);
+      return NULL;
+    }
+  }
+  if (!m->dynsym || !m->dynstr || !m->nsyms || strsz <= 0 ||
+      pltrel != DT_RELA || m->dynstr[strsz - 1] != '\0') {
+    load_error(m, path, "bad dynamic symbol table", ENOEXEC);
+    return NULL;
+  }
+
+  for (int i = 0; i < m->nneeded; i++) {
+    if (needed[i] >= strsz) {
+      load_error(m, path, "bad DT_NEEDED entry", ENOEXEC);
+      return NULL;
+    }
+    m->needed[i] = dlopen(m->dynstr + needed[i], RTLD_NOW | RTLD_LOCAL);
+    if (!m->needed[i]) {
+      load_error(m, path, dlerror(), ENOENT);
+      return NULL;
+    }
+  }
+
+  const char *policy_error = check_policy(m);
+  if (policy_error) {
+    load_error(m, path, policy_error, EPERM);
+    return NULL;
+  }
+
+  // Fixed-address builds only run in the reservation baked into their checks
+  m->fixed_base = read_long_symbol(m, "__fluke_fixed_base");
+  m->fixed_limit = read_long_symbol(m, "__fluke_fixed_limit");
+  // Other builds treat process_limit as const
+  m->growable = read_long_symbol(m, "__fluke_growable") != 0;
+
+  err = bind_symbols(m);
+  if (!err) {
+    err = bind_import_table(m);
+  }
+  if (err) {
+    load_error(m, path, "unresolved imports", err);
+    return NULL;
+  }
+  return m;
+}
+
+void fluke_module_free(fluke_module *m) {
+  if (!m) {
+    return;
+  }
+  for (int i = 0; i < m->nneeded; i++) {
+    if (m->needed[i]) {
+      dlclose(m->needed[i]);
+    }
+  }
+  free(m->syms);
+  free(m->imports);
+  free(m->file);
+  free(m);
+}
+
+fluke_export_t fluke_module_export(const fluke_module *m, const char *name) {
+  long i = find_symbol(m, name);
+  if (i < 0 || ELF64_ST_TYPE(m->dynsym[i].st_info) != STT_FUNC) {
+    return -1;
+  }
+  return m->dynsym[i].st_value;
+}
+
+//===----------------------------------------------------------------------===//
+// Stats
+//===----------------------------------------------------------------------===//
+
+// Instances of one process share a FLUKE_STATS_NAME segment laid out as the
+// loader's, so fluke-stats sees them too. Without the segment, or once its
+// slots run out, an instance keeps its stats to itself.
+static struct fluke_stats_header *stats_segment;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static char stats_name[64];
+
+static void stats_unlink(void) { shm_unlink(stats_name); }
+
+static void stats_open(void) {
+  snprintf(stats_name, sizeof(stats_name), FLUKE_STATS_NAME, (int)getpid());
+  int fd = shm_open(stats_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return;
+  }
+
+  long size = sizeof(struct fluke_stats_header) +
+              FLUKE_STATS_SLOTS * sizeof(struct fluke_stats);
+  void *map = ftruncate(fd, size) < 0
+                  ? MAP_FAILED
+                  : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(stats_name);
+    return;
+  }
+
+  struct fluke_stats_header *hdr = map;
+  hdr->version = FLUKE_STATS_VERSION;
+  hdr->slots = FLUKE_STATS_SLOTS;
+  __atomic_store_n(&hdr->magic, FLUKE_STATS_MAGIC, __ATOMIC_RELEASE);
+  stats_segment = hdr;
+  atexit(stats_unlink);
+}
+
+// A slot is free while its pid is 0
+static struct fluke_stats *stats_claim(fluke_instance *inst) {
+  unsigned long pid = getpid();
+  pthread_once(&stats_once, stats_open);
+  if (stats_segment) {
+    struct fluke_stats *slots = (struct fluke_stats *)(stats_segment + 1);
+    for (int i = 0; i < FLUKE_STATS_SLOTS; i++) {
+      unsigned long expected = 0;
+      if (__atomic_compare_exchange_n(&slots[i].pid, &expected, pid, 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return &slots[i];
+      }
+    }
+  }
+  inst->own_stats.pid = pid;
+  return &inst->own_stats;
+}
+
+static void stats_release(fluke_instance *inst) {
+  struct fluke_stats *s = inst->stats;
+  if (!s || s == &inst->own_stats) {
+    return;
+  }
+  memset(&s->entries, 0, sizeof(*s) - offsetof(struct fluke_stats, entries));
+  __atomic_store_n(&s->pid, 0, __ATOMIC_RELEASE);
+}
+
+//===----------------------------------------------------------------------===//
+// Instances
+//===----------------------------------------------------------------------===//
+
+static long symbol_address(fluke_instance *inst,
+                           const struct fluke_symbol *s) {
+  switch (s->bind) {
+  case BIND_GUEST: return (long)inst->base + s->value;
+  case BIND_HOST: return s->value;
+  case BIND_BASE: return (long)&inst->base_var;
+  case BIND_LIMIT: return (long)&inst->limit_var;
+  case BIND_LIMIT_MAX: return (long)&inst->limit_max_var;
+  case BIND_STATS: return (long)inst->stats;
+  case BIND_UNDEF: break;
+  }
+  return 0;
+}
+
+// Host functions are called through a thunk that counts the call in the
+// instance's hostcalls:
+//   movabs $counter, %r11; lock incq (%r11); movabs $target, %r11; jmp *%r11
+// r11 is free at every call boundary, and the jmp leaves the stack as the
+// caller set it up.
+static long host_thunk(fluke_instance *inst, long index, long target) {
+  unsigned char *t = inst->thunks + index * FLUKE_THUNK_SIZE;
+  unsigned long *counter = &inst->stats->hostcalls;
+  static const unsigned char inc[] = {0xf0, 0x49, 0xff, 0x03};
+  static const unsigned char jmp[] = {0x41, 0xff, 0xe3};
+
+  unsigned char *p = t;
+  *p++ = 0x49;
+  *p++ = 0xbb;
+  memcpy(p, &counter, sizeof(counter));
+  p += sizeof(counter);
+  memcpy(p, inc, sizeof(inc));
+  p += sizeof(inc);
+  *p++ = 0x49;
+  *p++ = 0xbb;
+  memcpy(p, &target, sizeof(target));
+  p += sizeof(target);
+  memcpy(p, jmp, sizeof(jmp));
+  p += sizeof(jmp);
+  memset(p, 0xcc, t + FLUKE_THUNK_SIZE - p);
+  return (long)t;
+}
+
+static int relocate(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  for (int t = 0; t < 2; t++) {
+    for (long i = 0; i < m->nrela[t]; i++) {
+      const Elf64_Rela *r = &m->rela[t][i];
+      long sym = ELF64_R_SYM(r->r_info);
+      if (r->r_offset + sizeof(long) > (unsigned long)m->image_size ||
+          sym >= m->nsyms) {
+        return ENOEXEC;
+      }
+
+      long *where = (long *)(inst->base + r->r_offset);
+      switch (ELF64_R_TYPE(r->r_info)) {
+      case R_X86_64_NONE:
+        break;
+      case R_X86_64_RELATIVE:
+        *where = (long)inst->base + r->r_addend;
+        break;
+      case R_X86_64_64:
+        *where = symbol_address(inst, &m->syms[sym]) + r->r_addend;
+        break;
+      case R_X86_64_GLOB_DAT:
+        *where = symbol_address(inst, &m->syms[sym]);
+        break;
+      case R_X86_64_JUMP_SLOT:
+        // Only calls are counted; data and address-taken functions keep
+        // their real address
+        *where = m->syms[sym].bind == BIND_HOST
+                     ? host_thunk(inst, sym, m->syms[sym].value)
+                     : symbol_address(inst, &m->syms[sym]);
+        break;
+      default:
+        fprintf(stderr, "fluke: unsupported relocation type %ld\n",
+                (long)ELF64_R_TYPE(r->r_info));
+        return ENOEXEC;
+      }
+    }
+  }
+  return 0;
+}
+
+// Fills the table import-table routes host calls through with the
+// bindings fluke_module_load resolved
+static void fill_import_table(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  void **slots = (void **)(inst->base + m->imports_table);
+  for (long i = 0; i < m->nimports; i++) {
+    const struct fluke_symbol *sym = &m->imports[i];
+    slots[i] = sym->bind == BIND_HOST
+                   ? (void *)host_thunk(inst, m->nsyms + i, sym->value)
+                   : (void *)symbol_address(inst, sym);
+  }
+}
+
+static int protect_segments(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  for (int i = 0; i < m->phnum; i++) {
+    const Elf64_Phdr *ph = &m->phdrs[i];
+    if (ph->p_type != PT_LOAD) {
+      continue;
+    }
+    int prot = (ph->p_flags & PF_R ? PROT_READ : 0) |
+               (ph->p_flags & PF_W ? PROT_WRITE : 0) |
+               (ph->p_flags & PF_X ? PROT_EXEC : 0);
+    long start = page_down(ph->p_vaddr);
+    if (mprotect(inst->base + start, page_up(ph->p_vaddr + ph->p_memsz) - start,
+                 prot) < 0) {
+      return errno;
+    }
+  }
+  if (m->relro.end > m->relro.start &&
+      mprotect(inst->base + m->relro.start, m->relro.end - m->relro.start,
+               PROT_READ) < 0) {
+    return errno;
+  }
+  return 0;
+}
+
+// Writable part of a PT_LOAD segment after RELRO, or an empty range
+static struct fluke_range writable_range(const fluke_module *m, int i) {
+  const Elf64_Phdr *ph = &m->phdrs[i];
+  struct fluke_range r = {0, 0};
+  if (ph->p_type == PT_LOAD && (ph->p_flags & PF_W)) {
+    r.start = ph->p_vaddr;
+    r.end = ph->p_vaddr + ph->p_memsz;
+    if (m->relro.end > r.start) {
+      r.start = m->relro.end < r.end ? m->relro.end : r.end;
+    }
+  }
+  return r;
+}
+
+static int call_guest(fluke_instance *inst, void *fn, const long *args,
+                      long *ret) {
+  fluke_instance *prev = fluke_current;
+  int prev_in_call = fluke_in_call;
+  fluke_current = inst;
+  fluke_in_call = 1;
+
+  int err = 0;
+  if (setjmp(inst->trap) == 0) {
+    long r = fluke_call_on_stack(inst->stack_top, fn, args);
+    if (ret) {
+      *ret = r;
+    }
+  } else if (inst->exit_status < 0) {
+    err = EFAULT;
+  } else if (ret) {
+    *ret = inst->exit_status;
+  }
+
+  fluke_in_call = prev_in_call;
+  fluke_current = prev;
+  return err;
+}
+
+static int run_constructors(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  long args[FLUKE_MAX_ARGS] = {0};
+  int err = 0;
+
+  if (m->init) {
+    err = call_guest(inst, inst->base + m->init, args, NULL);
+  }
+  for (long i = 0; !err && !inst->dead && i < m->init_count; i++) {
+    void *fn = ((void **)(inst->base + m->init_array))[i];
+    if (fn && fn != (void *)-1) {
+      err = call_guest(inst, fn, args, NULL);
+    }
+  }
+  return err ? err : inst->dead ? ECANCELED : 0;
+}
+
+static int take_snapshot(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  inst->data_snapshots = calloc(m->phnum, sizeof(char *));
+  if (!inst->data_snapshots) {
+    return ENOMEM;
+  }
+  for (int i = 0; i < m->phnum; i++) {
+    struct fluke_range r = writable_range(m, i);
+    if (r.end > r.start) {
+      inst->data_snapshots[i] = malloc(r.end - r.start);
+      if (!inst->data_snapshots[i]) {
+        return ENOMEM;
+      }
+      memcpy(inst->data_snapshots[i], inst->base + r.start, r.end - r.start);
+    }
+  }
+
+  long used = inst->heap_bump - inst->heap_start;
+  inst->heap_snapshot = malloc(used ? used : 1);
+  if (!inst->heap_snapshot) {
+    return ENOMEM;
+  }
+  memcpy(inst->heap_snapshot, inst->heap_start, used);
+  inst->heap_snapshot_bump = inst->heap_bump;
+
+  long meta = used / FLUKE_HEAP_GRANULE * sizeof(unsigned);
+  inst->meta_snapshot = malloc(meta ? meta : 1);
+  if (!inst->meta_snapshot) {
+    return ENOMEM;
+  }
+  memcpy(inst->meta_snapshot, inst->heap_meta, meta);
+  memcpy(inst->free_snapshot, inst->free_lists, sizeof(inst->free_lists));
+  inst->natexit_snapshot = inst->natexit;
+  return 0;
+}
+
+fluke_instance *fluke_instance_create(fluke_module *m) {
+  fluke_instance *inst = calloc(1, sizeof(*inst));
+  if (!inst) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  inst->m = m;
+  pthread_mutex_init(&inst->heap_lock, NULL);
+  pthread_mutex_init(&inst->thread_lock, NULL);
+
+  long min = m->image_size + FLUKE_PAGE_SIZE + FLUKE_STACK_SIZE;
+  void *hint = NULL;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  inst->size = FLUKE_REGION_SIZE;
+  if (m->fixed_base) {
+    hint = (void *)m->fixed_base;
+    inst->size = m->fixed_limit - m->fixed_base;
+    flags |= MAP_FIXED_NOREPLACE;
+  }
+  if (inst->size < min) {
+    fprintf(stderr, "fluke: region too small for image\n");
+    free(inst);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // A floating region is reserved 2 MiB aligned, so transparent huge pages
+  // can back the image and heap as they are committed. FLUKE_HUGEPAGES=0
+  // keeps it on small pages.
+  const char *hugepages = getenv("FLUKE_HUGEPAGES");
+  int huge = !m->fixed_base && !(hugepages && strcmp(hugepages, "0") == 0);
+  long slack = huge ? FLUKE_HUGE_PAGE_SIZE : 0;
+
+  char *raw = mmap(hint, inst->size + slack, PROT_NONE, flags, -1, 0);
+  if (raw == MAP_FAILED) {
+    int err = errno;
+    if (m->fixed_base) {
+      fprintf(stderr, "fluke: [%#lx, %#lx) is not available\n",
+              m->fixed_base, m->fixed_limit);
+    }
+    free(inst);
+    errno = err;
+    return NULL;
+  }
+
+  inst->base = raw;
+  if (huge) {
+    inst->base = (char *)(((unsigned long)raw + FLUKE_HUGE_PAGE_SIZE - 1) &
+                          ~(FLUKE_HUGE_PAGE_SIZE - 1));
+    if (inst->base > raw) {
+      munmap(raw, inst->base - raw);
+    }
+    if (raw + slack > inst->base) {
+      munmap(inst->base + inst->size, raw + slack - inst->base);
+    }
+    madvise(inst->base, inst->size, MADV_HUGEPAGE);
+  }
+
+  inst->base_var = inst->base;
+  inst->limit_var = inst->base;
+  inst->limit_max_var = inst->base + inst->size;
+  inst->stats = stats_claim(inst);
+
+  char *stack = inst->base + m->image_size + FLUKE_PAGE_SIZE;
+  inst->stack_top = stack + FLUKE_STACK_SIZE;
+  inst->heap_start = inst->heap_bump = inst->stack_top;
+
+  // Host pages for heap_meta are only touched as the heap grows
+  long granules = (inst->base + inst->size - inst->heap_start) /
+                  FLUKE_HEAP_GRANULE;
+  inst->heap_meta_size = page_up(granules * sizeof(unsigned));
+  inst->heap_meta = granules < META_FREE
+                        ? mmap(NULL, inst->heap_meta_size,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                               0)
+                        : MAP_FAILED;
+  int err = 0;
+  if (inst->heap_meta == MAP_FAILED) {
+    inst->heap_meta = NULL;
+    err = ENOMEM;
+  }
+  if (!err) {
+    // Checks in builds without FLUKE_GROWABLE may keep the first limit they
+    // load, so those get the whole reservation before the guest runs
+    err = commit_to(inst, m->growable ? inst->heap_start
+                                      : inst->base + inst->size);
+  }
+  if (!err) {
+    // The guard page under the stack stays reserved but inaccessible
+    err = mprotect(inst->base + m->image_size, FLUKE_PAGE_SIZE, PROT_NONE) < 0
+              ? errno
+              : 0;
+  }
+  for (int i = 0; !err && i < m->phnum; i++) {
+    const Elf64_Phdr *ph = &m->phdrs[i];
+    if (ph->p_type == PT_LOAD) {
+      memcpy(inst->base + ph->p_vaddr, m->file + ph->p_offset, ph->p_filesz);
+    }
+  }
+  if (!err) {
+    inst->thunks_size =
+        page_up((m->nsyms + m->nimports) * FLUKE_THUNK_SIZE);
+    inst->thunks = mmap(NULL, inst->thunks_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (inst->thunks == MAP_FAILED) {
+      inst->thunks = NULL;
+      err = ENOMEM;
+    }
+  }
+  if (!err) {
+    err = relocate(inst);
+  }
+  if (!err) {
+    fill_import_table(inst);
+    err = mprotect(inst->thunks, inst->thunks_size, PROT_READ | PROT_EXEC) < 0
+              ? errno
+              : protect_segments(inst);
+  }
+  if (!err) {
+    err = run_constructors(inst);
+  }
+  if (!err) {
+    err = take_snapshot(inst);
+  }
+  if (err) {
+    fluke_instance_destroy(inst);
+    errno = err;
+    return NULL;
+  }
+  return inst;
+}
+
+void fluke_instance_destroy(fluke_instance *inst) {
+  if (!inst) {
+    return;
+  }
+
+  const fluke_module *m = inst->m;
+  long args[FLUKE_MAX_ARGS] = {0};
+  if (!inst->dead && inst->data_snapshots) {
+    while (inst->natexit > 0 && !inst->dead) {
+      inst->natexit--;
+      args[0] = (long)inst->atexit[inst->natexit].arg;
+      call_guest(inst, (void *)inst->atexit[inst->natexit].fn, args, NULL);
+    }
+    for (long i = m->fini_count - 1; i >= 0 && !inst->dead; i--) {
+      void *fn = ((void **)(inst->base + m->fini_array))[i];
+      if (fn && fn != (void *)-1) {
+        call_guest(inst, fn, args, NULL);
+      }
+    }
+    if (m->fini && !inst->dead) {
+      call_guest(inst, inst->base + m->fini, args, NULL);
+    }
+  }
+
+  if (inst->data_snapshots) {
+    for (int i = 0; i < m->phnum; i++) {
+      free(inst->data_snapshots[i]);
+    }
+    free(inst->data_snapshots);
+  }
+  free(inst->heap_snapshot);
+  free(inst->meta_snapshot);
+  if (inst->heap_meta) {
+    munmap(inst->heap_meta, inst->heap_meta_size);
+  }
+  munmap(inst->base, inst->size);
+  if (inst->thunks) {
+    munmap(inst->thunks, inst->thunks_size);
+  }
+  stats_release(inst);
+  pthread_mutex_destroy(&inst->heap_lock);
+  pthread_mutex_destroy(&inst->thread_lock);
+  free(inst);
+}
+
+int fluke_instance_call(fluke_instance *inst, fluke_export_t fn,
+                        const long *args, int nargs, long *ret) {
+  if (fn < 0 || fn >= inst->m->image_size || nargs < 0 ||
+      nargs > FLUKE_MAX_ARGS) {
+    return EINVAL;
+  }
+  if (inst->dead) {
+    return EFAULT;
+  }
+
+  long regs[FLUKE_MAX_ARGS] = {0};
+  if (nargs) {
+    memcpy(regs, args, nargs * sizeof(long));
+  }
+
+  // Thread CPU time would cost a syscall per call, so only wall time
+  long start = now_ns();
+  int err = call_guest(inst, inst->base + fn, regs, ret);
+  __atomic_fetch_add(&inst->stats->entries, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&inst->stats->wall_ns, now_ns() - start,
+                     __ATOMIC_RELAXED);
+  return err;
+}
+
+int fluke_instance_entry(fluke_instance *inst, long *ret) {
+  fluke_export_t fn = fluke_module_export(inst->m, "entry");
+  return fn < 0 ? ENOENT : fluke_instance_call(inst, fn, NULL, 0, ret);
+}
+
+int fluke_instance_reset(fluke_instance *inst) {
+  const fluke_module *m = inst->m;
+  for (int i = 0; i < m->phnum; i++) {
+    struct fluke_range r = writable_range(m, i);
+    if (r.end > r.start) {
+      memcpy(inst->base + r.start, inst->data_snapshots[i], r.end - r.start);
+    }
+  }
+
+  pthread_mutex_lock(&inst->heap_lock);
+  memcpy(inst->heap_start, inst->heap_snapshot,
+         inst->heap_snapshot_bump - inst->heap_start);
+  long kept = (inst->heap_snapshot_bump - inst->heap_start) /
+              FLUKE_HEAP_GRANULE;
+  long used = (inst->heap_bump - inst->heap_start) / FLUKE_HEAP_GRANULE;
+  memcpy(inst->heap_meta, inst->meta_snapshot, kept * sizeof(unsigned));
+  memset(inst->heap_meta + kept, 0, (used - kept) * sizeof(unsigned));
+  memcpy(inst->free_lists, inst->free_snapshot, sizeof(inst->free_lists));
+  set_heap_bump(inst, inst->heap_snapshot_bump);
+
+  // Nothing a previous call wrote survives into the next one; the dropped
+  // pages stay committed and read back as zeroes
+  char *stack = inst->stack_top - FLUKE_STACK_SIZE;
+  char *dirty = (char *)page_up((long)inst->heap_bump);
+  char *limit = (char *)inst->limit_var;
+  int err = 0;
+  if (madvise(stack, FLUKE_STACK_SIZE, MADV_DONTNEED) < 0 ||
+      (limit > dirty && madvise(dirty, limit - dirty, MADV_DONTNEED) < 0)) {
+    err = errno;
+  }
+  pthread_mutex_unlock(&inst->heap_lock);
+
+  inst->natexit = inst->natexit_snapshot;
+  inst->dead = 0;
+  inst->exit_status = 0;
+  return err;
+}
+
+void *fluke_instance_alloc(fluke_instance *inst, long size) {
+  if (size < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return heap_alloc(inst, size, 0);
+}
+
+const struct fluke_stats *fluke_instance_stats(const fluke_instance *inst) {
+  return inst->stats;
+}
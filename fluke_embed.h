@@ -0,0 +1,63 @@
+#ifndef FLUKE_EMBED_H
+#define FLUKE_EMBED_H
+
+#include "stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In-process host for fluke guests. A module parses a guest .so once; each
+// instance maps its own copy into a private region, runs its constructors
+// and then serves any number of calls. Calls on one instance must not
+// overlap, while different instances may be used from different threads.
+//
+// Functions returning int return 0 or an errno value. Functions returning
+// pointers return NULL and set errno.
+typedef struct fluke_module fluke_module;
+typedef struct fluke_instance fluke_instance;
+
+// Offset of an exported guest function, valid for every instance of the
+// module that produced it
+typedef long fluke_export_t;
+
+#define FLUKE_MAX_ARGS 6
+
+// Fails with EPERM unless the module's __fluke_policy satisfies the host's
+// FLUKE_POLICY (read-write unless set to write-only)
+fluke_module *fluke_module_load(const char *path);
+void fluke_module_free(fluke_module *m);
+
+// Returns -1 if the module exports no function called `name`
+fluke_export_t fluke_module_export(const fluke_module *m, const char *name);
+
+fluke_instance *fluke_instance_create(fluke_module *m);
+void fluke_instance_destroy(fluke_instance *inst);
+
+// Calls fn with up to FLUKE_MAX_ARGS integer or guest-pointer arguments on
+// the instance's own stack. *ret receives the raw return register, so
+// callers truncate it for narrower return types. A bounds violation returns
+// EFAULT; after that, and after the guest calls exit(), the instance refuses
+// calls until it is reset.
+int fluke_instance_call(fluke_instance *inst, fluke_export_t fn,
+                        const long *args, int nargs, long *ret);
+
+// Shorthand for calling the patched `entry` export
+int fluke_instance_entry(fluke_instance *inst, long *ret);
+
+// Restores the guest's writable data and heap to their state right after
+// the constructors ran, and drops every page written since.
+int fluke_instance_reset(fluke_instance *inst);
+
+// Allocates from the guest heap, so buffers can be passed as arguments
+void *fluke_instance_alloc(fluke_instance *inst, long size);
+
+// The instance's slot in the process's FLUKE_STATS_NAME segment, which
+// fluke-stats reads, or private counters if the segment is unavailable
+const struct fluke_stats *fluke_instance_stats(const fluke_instance *inst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+// Run guests in-process through fluke_embed, keeping instances warm.
+//
+//   fluke-run [-n calls] [-r] [-f function] guest.so...
+//
+// Each guest gets one instance whose function (default `entry`) is called
+// `calls` times, resetting it between calls with -r. Per-call latency is
+// printed so it can be compared with spawning a loader per run.
+
+#include "fluke_embed.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int run_guest(const char *path, const char *function, long calls,
+                     int reset) {
+  long start = now_ns();
+  fluke_module *m = fluke_module_load(path);
+  if (!m) {
+    return 1;
+  }
+  fluke_instance *inst = fluke_instance_create(m);
+  if (!inst) {
+    perror(path);
+    fluke_module_free(m);
+    return 1;
+  }
+  long ready = now_ns();
+
+  int status = 0;
+  fluke_export_t fn = fluke_module_export(m, function);
+  if (fn < 0) {
+    fprintf(stderr, "%s: no function %s\n", path, function);
+    status = 1;
+  }
+
+  long first = 0, total = 0, reset_ns = 0;
+  for (long i = 0; i < calls && !status; i++) {
+    if (reset && i > 0) {
+      long t = now_ns();
+      int err = fluke_instance_reset(inst);
+      reset_ns += now_ns() - t;
+      if (err) {
+        fprintf(stderr, "%s: reset: %s\n", path, strerror(err));
+        status = 1;
+        break;
+      }
+    }
+
+    long ret = 0, t = now_ns();
+    int err = fluke_instance_call(inst, fn, NULL, 0, &ret);
+    long elapsed = now_ns() - t;
+    total += elapsed;
+    first = i == 0 ? elapsed : first;
+    if (err) {
+      fprintf(stderr, "%s: call %ld: %s\n", path, i, strerror(err));
+      status = 1;
+    }
+  }
+
+  fflush(stdout);
+  const struct fluke_stats *st = fluke_instance_stats(inst);
+  fprintf(stderr,
+          "%s: load %.3f ms, first call %.3f ms, warm call %.3f ms, "
+          "reset %.3f ms, heap %lu KiB, hostcalls %lu, violations %lu\n",
+          path, (ready - start) / 1e6, first / 1e6,
+          calls > 1 ? (total - first) / 1e6 / (calls - 1) : 0.0,
+          reset && calls > 1 ? reset_ns / 1e6 / (calls - 1) : 0.0,
+          st->heap_bytes >> 10, st->hostcalls, st->violations);
+
+  fluke_instance_destroy(inst);
+  fluke_module_free(m);
+  return status;
+}
+
+int main(int argc, char **argv) {
+  long calls = 1;
+  int reset = 0;
+  const char *function = "entry";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:rf:")) != -1) {
+    switch (opt) {
+    case 'n':
+      calls = atol(optarg);
+      break;
+    case 'r':
+      reset = 1;
+      break;
+    case 'f':
+      function = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n calls] [-r] [-f function] guest.so...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "Usage: %s [-n calls] [-r] [-f function] guest.so...\n",
+            argv[0]);
+    return 1;
+  }
+
+  int status = 0;
+  for (int i = optind; i < argc; i++) {
+    status |= run_guest(argv[i], function, calls, reset);
+  }
+  return status;
+}
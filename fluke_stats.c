@@ -0,0 +1,124 @@
+// Scrape per-instance stats from running loaders without stopping them.
+//
+//   fluke-stats [-i seconds] [loader-pid...]
+//
+// With no pids, every /fluke-stats-* segment in /dev/shm is read.
+
+#include "stats.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static int print_segment(int pid) {
+  char name[64];
+  snprintf(name, sizeof(name), FLUKE_STATS_NAME, pid);
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(name);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < sizeof(struct fluke_stats_header)) {
+    fprintf(stderr, "%s: truncated segment\n", name);
+    close(fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(name);
+    return -1;
+  }
+
+  const struct fluke_stats_header *hdr = map;
+  if (hdr->magic != FLUKE_STATS_MAGIC || hdr->version != FLUKE_STATS_VERSION) {
+    fprintf(stderr, "%s: unknown segment format\n", name);
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  const struct fluke_stats *slots = (const struct fluke_stats *)(hdr + 1);
+  size_t avail = ((size_t)st.st_size - sizeof(*hdr)) / sizeof(*slots);
+  size_t count = hdr->slots < avail ? hdr->slots : avail;
+
+  for (size_t i = 0; i < count; i++) {
+    const struct fluke_stats *s = &slots[i];
+    unsigned long entries = LOAD(s->entries);
+    if (entries == 0) {
+      continue;
+    }
+    printf("%8d %6zu %8lu %8lu %10.3f %10.3f %12lu %10lu %10lu\n", pid, i,
+           LOAD(s->pid), entries, LOAD(s->wall_ns) / 1e6,
+           LOAD(s->cpu_ns) / 1e6, LOAD(s->heap_bytes), LOAD(s->hostcalls),
+           LOAD(s->violations));
+  }
+
+  munmap(map, st.st_size);
+  return 0;
+}
+
+static int scan_all(void) {
+  DIR *dir = opendir("/dev/shm");
+  if (!dir) {
+    perror("/dev/shm");
+    return -1;
+  }
+
+  int ret = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    int pid;
+    if (sscanf(ent->d_name, FLUKE_STATS_NAME + 1, &pid) == 1) {
+      ret |= print_segment(pid);
+    }
+  }
+
+  closedir(dir);
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  unsigned interval = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:")) != -1) {
+    if (opt == 'i') {
+      interval = (unsigned)atoi(optarg);
+    } else {
+      fprintf(stderr, "usage: %s [-i seconds] [loader-pid...]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  for (;;) {
+    printf("%8s %6s %8s %8s %10s %10s %12s %10s %10s\n", "loader", "slot",
+           "pid", "entries", "wall_ms", "cpu_ms", "heap_bytes", "hostcalls",
+           "violations");
+
+    int ret = 0;
+    if (optind == argc) {
+      ret = scan_all();
+    } else {
+      for (int i = optind; i < argc; i++) {
+        ret |= print_segment(atoi(argv[i]));
+      }
+    }
+
+    if (interval == 0) {
+      return ret ? 1 : 0;
+    }
+    fflush(stdout);
+    sleep(interval);
+  }
+}
@@ -0,0 +1,159 @@
+// programs/hashtable.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+#define EMPTY 0
+#define TOMBSTONE 1
+
+typedef struct {
+  uint64_t *keys;
+  uint64_t *values;
+  size_t cap;
+  size_t len;
+} Table;
+
+static uint64_t rng_state_ht = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rand_u64(void) {
+  uint64_t x = rng_state_ht;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  rng_state_ht = x;
+  return x;
+}
+
+static uint64_t hash_u64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+static int table_init(Table *t, size_t cap) {
+  t->keys = (uint64_t *)calloc(cap, sizeof(uint64_t));
+  t->values = (uint64_t *)malloc(cap * sizeof(uint64_t));
+  t->cap = cap;
+  t->len = 0;
+  return t->keys && t->values;
+}
+
+// Linear probing; keys 0 and 1 are reserved as markers.
+static void table_put(Table *t, uint64_t key, uint64_t value) {
+  size_t mask = t->cap - 1;
+  size_t i = hash_u64(key) & mask;
+  size_t slot = t->cap;
+
+  while (t->keys[i] != EMPTY) {
+    if (t->keys[i] == key) {
+      t->values[i] = value;
+      return;
+    }
+    if (t->keys[i] == TOMBSTONE && slot == t->cap) {
+      slot = i;
+    }
+    i = (i + 1) & mask;
+  }
+
+  if (slot == t->cap) {
+    slot = i;
+  }
+  t->keys[slot] = key;
+  t->values[slot] = value;
+  t->len++;
+}
+
+static int table_get(const Table *t, uint64_t key, uint64_t *value) {
+  size_t mask = t->cap - 1;
+  size_t i = hash_u64(key) & mask;
+
+  while (t->keys[i] != EMPTY) {
+    if (t->keys[i] == key) {
+      *value = t->values[i];
+      return 1;
+    }
+    i = (i + 1) & mask;
+  }
+  return 0;
+}
+
+static int table_del(Table *t, uint64_t key) {
+  size_t mask = t->cap - 1;
+  size_t i = hash_u64(key) & mask;
+
+  while (t->keys[i] != EMPTY) {
+    if (t->keys[i] == key) {
+      t->keys[i] = TOMBSTONE;
+      t->len--;
+      return 1;
+    }
+    i = (i + 1) & mask;
+  }
+  return 0;
+}
+
+int entry(void) {
+  const size_t N = 400000 * SCALE;
+  size_t cap = 1;
+  while (cap < 2 * N) {
+    cap <<= 1;
+  }
+
+  Table t;
+  uint64_t *inserted = (uint64_t *)malloc(N * sizeof(uint64_t));
+  if (!table_init(&t, cap) || !inserted) {
+    perror("malloc");
+    return 1;
+  }
+
+  for (size_t i = 0; i < N; i++) {
+    uint64_t key = rand_u64() | 2;
+    inserted[i] = key;
+    table_put(&t, key, key * 31 + i);
+  }
+
+  // every inserted key must be found with its latest value
+  size_t hits = 0, misses = 0, bad = 0;
+  for (int round = 0; round < 4; round++) {
+    for (size_t i = 0; i < N; i++) {
+      uint64_t v;
+      if (table_get(&t, inserted[i], &v)) {
+        hits++;
+      } else {
+        bad++;
+      }
+      if (table_get(&t, rand_u64() | 2, &v)) {
+        misses++;
+      }
+    }
+  }
+
+  // drop every other key and confirm they are gone
+  for (size_t i = 0; i < N; i += 2) {
+    table_del(&t, inserted[i]);
+  }
+  for (size_t i = 0; i < N; i++) {
+    uint64_t v;
+    if (table_get(&t, inserted[i], &v) != (int)(i & 1)) {
+      bad++;
+    }
+  }
+
+  int ok = bad == 0 && t.len == N / 2;
+  printf("hashtable: N=%zu hits=%zu false_hits=%zu ok=%s\n", N, hits, misses,
+         ok ? "yes" : "no");
+
+  free(t.keys);
+  free(t.values);
+  free(inserted);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
@@ -0,0 +1,300 @@
+// programs/json.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+} Writer;
+
+typedef struct {
+  const char *s;
+  size_t pos;
+  size_t len;
+  int error;
+  long objects;
+  long numbers;
+  long number_sum;
+  long string_bytes;
+} Parser;
+
+static uint32_t rng_state_json = 24681357u;
+
+static int rand_int_json(void) {
+  uint32_t x = rng_state_json;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_json = x;
+  return (int)(x & 0x7fffffff);
+}
+
+static void put_char(Writer *w, char c) {
+  if (w->len < w->cap) {
+    w->buf[w->len] = c;
+  }
+  w->len++;
+}
+
+static void put_str(Writer *w, const char *s) {
+  while (*s) {
+    put_char(w, *s++);
+  }
+}
+
+static void put_long(Writer *w, long v) {
+  char digits[24];
+  int n = 0;
+  if (v < 0) {
+    put_char(w, '-');
+    v = -v;
+  }
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v > 0);
+  while (n > 0) {
+    put_char(w, digits[--n]);
+  }
+}
+
+// Emit one record and tally what the parser should find.
+static void emit_record(Writer *w, long id, Parser *expect) {
+  static const char *const words[] = {"alpha", "beta", "gamma", "delta",
+                                      "epsilon", "zeta", "eta", "theta"};
+  long price = rand_int_json() % 100000 - 50000;
+  long qty = rand_int_json() % 1000;
+  const char *name = words[rand_int_json() % 8];
+  int ntags = rand_int_json() % 4;
+
+  put_str(w, "{\"id\": ");
+  put_long(w, id);
+  put_str(w, ", \"name\": \"");
+  put_str(w, name);
+  put_str(w, "\\n\", \"price\": ");
+  put_long(w, price);
+  put_str(w, ", \"qty\": ");
+  put_long(w, qty);
+  put_str(w, ", \"active\": ");
+  put_str(w, (id & 1) ? "true" : "false");
+  put_str(w, ", \"tags\": [");
+  for (int i = 0; i < ntags; i++) {
+    if (i > 0) {
+      put_str(w, ", ");
+    }
+    put_char(w, '"');
+    put_str(w, words[(id + i) % 8]);
+    put_char(w, '"');
+    expect->string_bytes += (long)strlen(words[(id + i) % 8]);
+  }
+  put_str(w, "], \"meta\": null}");
+
+  expect->objects++;
+  expect->numbers += 3;
+  expect->number_sum += id + price + qty;
+  expect->string_bytes += (long)strlen(name) + 1; // name plus escaped newline
+  expect->string_bytes += 2 + 4 + 5 + 3 + 6 + 4 + 4; // keys
+}
+
+static void skip_ws(Parser *p) {
+  while (p->pos < p->len) {
+    char c = p->s[p->pos];
+    if (c != ' ' && c != '\n' && c != '\t' && c != '\r') {
+      break;
+    }
+    p->pos++;
+  }
+}
+
+static int expect_lit(Parser *p, const char *lit) {
+  size_t n = strlen(lit);
+  if (p->pos + n > p->len || memcmp(p->s + p->pos, lit, n) != 0) {
+    p->error = 1;
+    return 0;
+  }
+  p->pos += n;
+  return 1;
+}
+
+static void parse_value(Parser *p, int depth);
+
+static void parse_string(Parser *p) {
+  if (!expect_lit(p, "\"")) {
+    return;
+  }
+  while (p->pos < p->len && p->s[p->pos] != '"') {
+    if (p->s[p->pos] == '\\') {
+      p->pos++;
+    }
+    p->pos++;
+    p->string_bytes++;
+  }
+  expect_lit(p, "\"");
+}
+
+static void parse_number(Parser *p) {
+  int neg = 0;
+  long v = 0;
+  if (p->pos < p->len && p->s[p->pos] == '-') {
+    neg = 1;
+    p->pos++;
+  }
+  size_t start = p->pos;
+  while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') {
+    v = v * 10 + (p->s[p->pos] - '0');
+    p->pos++;
+  }
+  if (p->pos == start) {
+    p->error = 1;
+    return;
+  }
+  p->numbers++;
+  p->number_sum += neg ? -v : v;
+}
+
+static void parse_object(Parser *p, int depth) {
+  expect_lit(p, "{");
+  skip_ws(p);
+  if (p->pos < p->len && p->s[p->pos] == '}') {
+    p->pos++;
+    p->objects++;
+    return;
+  }
+  while (!p->error) {
+    skip_ws(p);
+    parse_string(p);
+    skip_ws(p);
+    expect_lit(p, ":");
+    parse_value(p, depth + 1);
+    skip_ws(p);
+    if (p->pos < p->len && p->s[p->pos] == ',') {
+      p->pos++;
+      continue;
+    }
+    if (expect_lit(p, "}")) {
+      p->objects++;
+    }
+    return;
+  }
+}
+
+static void parse_array(Parser *p, int depth) {
+  expect_lit(p, "[");
+  skip_ws(p);
+  if (p->pos < p->len && p->s[p->pos] == ']') {
+    p->pos++;
+    return;
+  }
+  while (!p->error) {
+    parse_value(p, depth + 1);
+    skip_ws(p);
+    if (p->pos < p->len && p->s[p->pos] == ',') {
+      p->pos++;
+      continue;
+    }
+    expect_lit(p, "]");
+    return;
+  }
+}
+
+static void parse_value(Parser *p, int depth) {
+  if (depth > 64) {
+    p->error = 1;
+    return;
+  }
+  skip_ws(p);
+  if (p->pos >= p->len) {
+    p->error = 1;
+    return;
+  }
+
+  switch (p->s[p->pos]) {
+  case '{':
+    parse_object(p, depth);
+    break;
+  case '[':
+    parse_array(p, depth);
+    break;
+  case '"':
+    parse_string(p);
+    break;
+  case 't':
+    expect_lit(p, "true");
+    break;
+  case 'f':
+    expect_lit(p, "false");
+    break;
+  case 'n':
+    expect_lit(p, "null");
+    break;
+  default:
+    parse_number(p);
+    break;
+  }
+}
+
+int entry(void) {
+  const long RECORDS = 100000L * SCALE;
+  const int PASSES = 8;
+
+  Writer w = {NULL, 0, 0};
+  Parser expect;
+  memset(&expect, 0, sizeof(expect));
+
+  // size the document first, then render it for real
+  for (int pass = 0; pass < 2; pass++) {
+    uint32_t seed = rng_state_json;
+    w.len = 0;
+    memset(&expect, 0, sizeof(expect));
+    put_char(&w, '[');
+    for (long i = 0; i < RECORDS; i++) {
+      if (i > 0) {
+        put_str(&w, ",\n ");
+      }
+      emit_record(&w, i, &expect);
+    }
+    put_char(&w, ']');
+
+    if (pass == 0) {
+      w.cap = w.len;
+      w.buf = (char *)malloc(w.cap);
+      if (!w.buf) {
+        perror("malloc");
+        return 1;
+      }
+      rng_state_json = seed;
+    }
+  }
+
+  int ok = 1;
+  for (int i = 0; i < PASSES; i++) {
+    Parser p;
+    memset(&p, 0, sizeof(p));
+    p.s = w.buf;
+    p.len = w.len;
+    parse_value(&p, 0);
+    skip_ws(&p);
+
+    if (p.error || p.pos != p.len || p.objects != expect.objects ||
+        p.numbers != expect.numbers || p.number_sum != expect.number_sum ||
+        p.string_bytes != expect.string_bytes) {
+      ok = 0;
+      break;
+    }
+  }
+
+  printf("json: records=%ld bytes=%zu objects=%ld sum=%ld ok=%s\n", RECORDS,
+         w.len, expect.objects, expect.number_sum, ok ? "yes" : "no");
+
+  free(w.buf);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
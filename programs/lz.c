@@ -0,0 +1,198 @@
+// programs/lz.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 14
+
+static uint32_t rng_state_lz = 192837465u;
+
+static int rand_int_lz(void) {
+  uint32_t x = rng_state_lz;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_lz = x;
+  return (int)(x & 0x7fffffff);
+}
+
+// Log-like text: repetitive structure with varying fields.
+static void make_input(uint8_t *buf, size_t n) {
+  static const char *const levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+  static const char *const paths[] = {"/api/users", "/api/orders",
+                                      "/static/app.js", "/health"};
+  size_t pos = 0;
+  long line = 0;
+
+  while (pos < n) {
+    char tmp[128];
+    int len = snprintf(tmp, sizeof(tmp),
+                       "%08ld %s request path=%s status=%d bytes=%d\n", line,
+                       levels[rand_int_lz() % 4], paths[rand_int_lz() % 4],
+                       200 + (rand_int_lz() % 4) * 100, rand_int_lz() % 65536);
+    for (int i = 0; i < len && pos < n; i++) {
+      buf[pos++] = (uint8_t)tmp[i];
+    }
+    line++;
+  }
+}
+
+static uint32_t read32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint32_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static size_t put_length(uint8_t *out, size_t op, size_t len) {
+  while (len >= 255) {
+    out[op++] = 255;
+    len -= 255;
+  }
+  out[op++] = (uint8_t)len;
+  return op;
+}
+
+static size_t emit_sequence(uint8_t *out, size_t op, const uint8_t *lit,
+                            size_t nlit, size_t offset, size_t mlen) {
+  size_t mcode = mlen ? mlen - MIN_MATCH : 0;
+  out[op++] = (uint8_t)(((nlit < 15 ? nlit : 15) << 4) |
+                        (mcode < 15 ? mcode : 15));
+  if (nlit >= 15) {
+    op = put_length(out, op, nlit - 15);
+  }
+  memcpy(out + op, lit, nlit);
+  op += nlit;
+
+  if (mlen) {
+    out[op++] = (uint8_t)(offset & 0xff);
+    out[op++] = (uint8_t)(offset >> 8);
+    if (mcode >= 15) {
+      op = put_length(out, op, mcode - 15);
+    }
+  }
+  return op;
+}
+
+// LZ4-style greedy compressor with a single-entry hash table.
+static size_t compress(const uint8_t *in, size_t n, uint8_t *out,
+                       uint32_t *table) {
+  memset(table, 0, sizeof(uint32_t) << HASH_BITS);
+  size_t ip = 0, anchor = 0, op = 0;
+
+  while (ip + MIN_MATCH <= n) {
+    uint32_t h = hash4(read32(in + ip));
+    size_t ref = table[h];
+    table[h] = (uint32_t)ip;
+
+    if (ref < ip && ip - ref <= MAX_OFFSET &&
+        read32(in + ref) == read32(in + ip)) {
+      size_t mlen = MIN_MATCH;
+      while (ip + mlen < n && in[ref + mlen] == in[ip + mlen]) {
+        mlen++;
+      }
+      op = emit_sequence(out, op, in + anchor, ip - anchor, ip - ref, mlen);
+      ip += mlen;
+      anchor = ip;
+    } else {
+      ip++;
+    }
+  }
+
+  // trailing literals close the stream
+  return emit_sequence(out, op, in + anchor, n - anchor, 0, 0);
+}
+
+static size_t get_length(const uint8_t *in, size_t *ip, size_t len) {
+  uint8_t b;
+  do {
+    b = in[(*ip)++];
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+static size_t decompress(const uint8_t *in, size_t n, uint8_t *out,
+                         size_t cap) {
+  size_t ip = 0, op = 0;
+
+  while (ip < n) {
+    uint8_t token = in[ip++];
+    size_t nlit = token >> 4;
+    if (nlit == 15) {
+      nlit = get_length(in, &ip, nlit);
+    }
+    if (op + nlit > cap || ip + nlit > n) {
+      return 0;
+    }
+    memcpy(out + op, in + ip, nlit);
+    op += nlit;
+    ip += nlit;
+
+    if (ip >= n) {
+      break;
+    }
+
+    size_t offset = in[ip] | ((size_t)in[ip + 1] << 8);
+    ip += 2;
+    size_t mlen = token & 15;
+    if (mlen == 15) {
+      mlen = get_length(in, &ip, mlen);
+    }
+    mlen += MIN_MATCH;
+
+    if (offset == 0 || offset > op || op + mlen > cap) {
+      return 0;
+    }
+    // byte-wise copy handles overlapping matches
+    for (size_t i = 0; i < mlen; i++) {
+      out[op + i] = out[op - offset + i];
+    }
+    op += mlen;
+  }
+  return op;
+}
+
+int entry(void) {
+  const size_t N = (size_t)(4 << 20) * SCALE;
+  const int ROUNDS = 4;
+
+  uint8_t *input = (uint8_t *)malloc(N);
+  uint8_t *packed = (uint8_t *)malloc(N + N / 255 + 16);
+  uint8_t *output = (uint8_t *)malloc(N);
+  uint32_t *table = (uint32_t *)malloc(sizeof(uint32_t) << HASH_BITS);
+  if (!input || !packed || !output || !table) {
+    perror("malloc");
+    return 1;
+  }
+
+  make_input(input, N);
+
+  int ok = 1;
+  size_t packed_len = 0;
+  for (int r = 0; r < ROUNDS && ok; r++) {
+    packed_len = compress(input, N, packed, table);
+    size_t out_len = decompress(packed, packed_len, output, N);
+    ok = out_len == N && memcmp(input, output, N) == 0;
+  }
+
+  printf("lz: bytes=%zu packed=%zu ratio=%.3f ok=%s\n", N, packed_len,
+         (double)packed_len / (double)N, ok ? "yes" : "no");
+
+  free(input);
+  free(packed);
+  free(output);
+  free(table);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
@@ -0,0 +1,98 @@
+// programs/par_matmul.c
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_THREADS 4
+
+struct worker {
+  const double *A;
+  const double *B;
+  double *C;
+  int n;
+  int row_begin;
+  int row_end;
+};
+
+static void *matmul_rows(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  int n = w->n;
+
+  for (int i = w->row_begin; i < w->row_end; i++) {
+    for (int k = 0; k < n; k++) {
+      double aik = w->A[(size_t)i * n + k];
+      for (int j = 0; j < n; j++) {
+        w->C[(size_t)i * n + j] += aik * w->B[(size_t)k * n + j];
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int entry(void) {
+  const int N = 512;
+  size_t total = (size_t)N * (size_t)N;
+
+  double *A = (double *)malloc(total * sizeof(double));
+  double *B = (double *)malloc(total * sizeof(double));
+  double *C = (double *)malloc(total * sizeof(double));
+
+  if (!A || !B || !C) {
+    perror("malloc");
+    free(A);
+    free(B);
+    free(C);
+    return 1;
+  }
+
+  // initialize A and B with deterministic values
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      A[(size_t)i * N + j] = (double)((i + 1) * (j + 1));
+      B[(size_t)i * N + j] = (double)((i == j) ? 1.0 : 0.0);
+      C[(size_t)i * N + j] = 0.0;
+    }
+  }
+
+  // split rows evenly across workers
+  pthread_t threads[NUM_THREADS];
+  struct worker workers[NUM_THREADS];
+  int rows = (N + NUM_THREADS - 1) / NUM_THREADS;
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    int begin = t * rows;
+    int end = begin + rows < N ? begin + rows : N;
+    workers[t] = (struct worker){A, B, C, N, begin, end};
+    if (pthread_create(&threads[t], NULL, matmul_rows, &workers[t]) != 0) {
+      fprintf(stderr, "par_matmul: pthread_create failed\n");
+      for (int u = 0; u < t; u++) {
+        pthread_join(threads[u], NULL);
+      }
+      free(A);
+      free(B);
+      free(C);
+      return 1;
+    }
+  }
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // basic checksum to prevent dead-code elimination
+  double checksum = 0.0;
+  for (int i = 0; i < N; i++) {
+    checksum += C[(size_t)i * N + i];
+  }
+
+  printf("par_matmul: N=%d threads=%d checksum=%f\n", N, NUM_THREADS,
+         checksum);
+
+  free(A);
+  free(B);
+  free(C);
+  return 0;
+}
+
+int main(void) { return entry(); }
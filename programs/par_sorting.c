@@ -0,0 +1,123 @@
+// programs/par_sorting.c
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_THREADS 4
+
+static uint32_t rng_state_sort = 987654321u;
+
+static int rand_int_sort(void) {
+  uint32_t x = rng_state_sort;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_sort = x;
+  return (int)(x & 0x7fffffff);
+}
+
+static void merge(int *arr, int *tmp, int left, int mid, int right) {
+  int i = left;
+  int j = mid + 1;
+  int k = left;
+
+  while (i <= mid && j <= right) {
+    if (arr[i] <= arr[j])
+      tmp[k++] = arr[i++];
+    else
+      tmp[k++] = arr[j++];
+  }
+  while (i <= mid)
+    tmp[k++] = arr[i++];
+  while (j <= right)
+    tmp[k++] = arr[j++];
+
+  for (i = left; i <= right; i++)
+    arr[i] = tmp[i];
+}
+
+static void mergesort_rec(int *arr, int *tmp, int left, int right) {
+  if (left >= right)
+    return;
+  int mid = left + (right - left) / 2;
+  mergesort_rec(arr, tmp, left, mid);
+  mergesort_rec(arr, tmp, mid + 1, right);
+  merge(arr, tmp, left, mid, right);
+}
+
+struct chunk {
+  int *arr;
+  int *tmp;
+  int left;
+  int right;
+};
+
+static void *sort_chunk(void *arg) {
+  struct chunk *c = (struct chunk *)arg;
+  mergesort_rec(c->arr, c->tmp, c->left, c->right);
+  return NULL;
+}
+
+int entry(void) {
+  const int N = 500000;
+  int *arr = (int *)malloc(N * sizeof(int));
+  int *tmp = (int *)malloc(N * sizeof(int));
+  if (!arr || !tmp) {
+    perror("malloc");
+    free(arr);
+    free(tmp);
+    return 1;
+  }
+
+  for (int i = 0; i < N; i++) {
+    arr[i] = rand_int_sort();
+  }
+
+  // sort disjoint chunks in parallel
+  pthread_t threads[NUM_THREADS];
+  struct chunk chunks[NUM_THREADS];
+  int per = (N + NUM_THREADS - 1) / NUM_THREADS;
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    int left = t * per;
+    int right = left + per - 1 < N - 1 ? left + per - 1 : N - 1;
+    chunks[t] = (struct chunk){arr, tmp, left, right};
+    if (pthread_create(&threads[t], NULL, sort_chunk, &chunks[t]) != 0) {
+      fprintf(stderr, "par_sorting: pthread_create failed\n");
+      for (int u = 0; u < t; u++) {
+        pthread_join(threads[u], NULL);
+      }
+      free(arr);
+      free(tmp);
+      return 1;
+    }
+  }
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // fold the sorted chunks together
+  for (int t = 1; t < NUM_THREADS; t++) {
+    merge(arr, tmp, 0, chunks[t].left - 1, chunks[t].right);
+  }
+
+  // sanity check: verify non-decreasing
+  int ok = 1;
+  for (int i = 1; i < N; i++) {
+    if (arr[i] < arr[i - 1]) {
+      ok = 0;
+      break;
+    }
+  }
+
+  printf("par_sorting: N=%d threads=%d sorted=%s\n", N, NUM_THREADS,
+         ok ? "yes" : "no");
+
+  free(arr);
+  free(tmp);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
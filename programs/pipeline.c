@@ -0,0 +1,263 @@
+// programs/pipeline.c
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+#define BLOCK (64 << 10)
+#define SLOTS 16
+#define STEP 0x0101010101010101ull
+
+// Resolved from the fluke runtime. Without it, or with FLUKE_PIPELINE=fifo,
+// stages pass blocks through FIFOs instead.
+struct fluke_channel;
+extern struct fluke_channel *fluke_channel_open(const char *name, long slots,
+                                                long slot_size)
+    __attribute__((weak));
+extern void fluke_channel_close(struct fluke_channel *ch) __attribute__((weak));
+extern void *fluke_channel_reserve(struct fluke_channel *ch)
+    __attribute__((weak));
+extern void fluke_channel_commit(struct fluke_channel *ch, long len)
+    __attribute__((weak));
+extern void fluke_channel_finish(struct fluke_channel *ch)
+    __attribute__((weak));
+extern const void *fluke_channel_peek(struct fluke_channel *ch, long *len)
+    __attribute__((weak));
+extern void fluke_channel_release(struct fluke_channel *ch)
+    __attribute__((weak));
+
+// One hop between neighbouring stages
+struct link {
+  struct fluke_channel *ch;
+  int fd;
+  uint64_t *buf;
+};
+
+static uint64_t block_word(long block, long i) {
+  uint64_t x = (uint64_t)block * 0x9e3779b97f4a7c15ull + (uint64_t)i + 1;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+static uint64_t fold(uint64_t h, uint64_t w) {
+  return ((h << 5) | (h >> 59)) ^ w;
+}
+
+static void path_of(char *out, long size, const char *key, int stage,
+                    const char *what) {
+  snprintf(out, size, "/tmp/fluke_pipeline_%s.%d.%s", key, stage, what);
+}
+
+// The first free stage, claimed with O_EXCL so concurrent instances agree
+static int claim_stage(const char *key, int stages) {
+  char path[128];
+  for (int i = 0; i < stages; i++) {
+    path_of(path, sizeof(path), key, i, "stage");
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+      close(fd);
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int link_open(struct link *l, const char *key, int hop, int out,
+                     int use_channel) {
+  l->ch = NULL;
+  l->fd = -1;
+  l->buf = NULL;
+
+  if (use_channel) {
+    char name[64];
+    snprintf(name, sizeof(name), "pipeline.%s.%d", key, hop);
+    l->ch = fluke_channel_open(name, SLOTS, BLOCK);
+    if (l->ch) {
+      return 0;
+    }
+  }
+
+  char path[128];
+  path_of(path, sizeof(path), key, hop, "fifo");
+  if (mkfifo(path, 0600) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  l->buf = (uint64_t *)malloc(BLOCK);
+  l->fd = open(path, out ? O_WRONLY : O_RDONLY);
+  return l->buf && l->fd >= 0 ? 0 : -1;
+}
+
+static uint64_t *link_reserve(struct link *l) {
+  return l->ch ? (uint64_t *)fluke_channel_reserve(l->ch) : l->buf;
+}
+
+static int link_commit(struct link *l, long len) {
+  if (l->ch) {
+    fluke_channel_commit(l->ch, len);
+    return 0;
+  }
+  for (long done = 0; done < len;) {
+    ssize_t n = write(l->fd, (char *)l->buf + done, len - done);
+    if (n <= 0) {
+      return -1;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+// The next block, or NULL once the upstream stage is finished
+static const uint64_t *link_next(struct link *l, long *len) {
+  if (l->ch) {
+    return (const uint64_t *)fluke_channel_peek(l->ch, len);
+  }
+  long done = 0;
+  while (done < BLOCK) {
+    ssize_t n = read(l->fd, (char *)l->buf + done, BLOCK - done);
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  *len = done;
+  return done ? l->buf : NULL;
+}
+
+static void link_release(struct link *l) {
+  if (l->ch) {
+    fluke_channel_release(l->ch);
+  }
+}
+
+static void link_close(struct link *l, int out) {
+  if (l->ch) {
+    if (out) {
+      fluke_channel_finish(l->ch);
+    }
+    fluke_channel_close(l->ch);
+  }
+  if (l->fd >= 0) {
+    close(l->fd);
+  }
+  free(l->buf);
+}
+
+static uint64_t expected_checksum(long blocks, int stages) {
+  uint64_t bump = stages > 2 ? STEP * (uint64_t)(stages - 2) : 0;
+  uint64_t h = 0;
+  for (long b = 0; b < blocks; b++) {
+    for (long i = 0; i < BLOCK / 8; i++) {
+      h = fold(h, block_word(b, i) + bump);
+    }
+  }
+  return h;
+}
+
+// Every instance claims the next stage of the pipeline named by
+// FLUKE_PIPELINE_KEY; FLUKE_PIPELINE_STAGES instances (default 1) make up one
+// pipeline. Stage 0 generates blocks, middle stages rewrite them and the last
+// stage checks them.
+int entry(void) {
+  const long BLOCKS = 4096L * SCALE;
+
+  const char *key = getenv("FLUKE_PIPELINE_KEY");
+  const char *mode = getenv("FLUKE_PIPELINE");
+  const char *stages_env = getenv("FLUKE_PIPELINE_STAGES");
+  int stages = stages_env ? atoi(stages_env) : 1;
+  key = key ? key : "0";
+  int use_channel =
+      fluke_channel_open && !(mode && strcmp(mode, "fifo") == 0);
+
+  if (stages <= 1) {
+    uint64_t h = 0;
+    for (long b = 0; b < BLOCKS; b++) {
+      for (long i = 0; i < BLOCK / 8; i++) {
+        h = fold(h, block_word(b, i));
+      }
+    }
+    int ok = h == expected_checksum(BLOCKS, 1);
+    printf("pipeline: stage=0/1 blocks=%ld ok=%s\n", BLOCKS, ok ? "yes" : "no");
+    return ok ? 0 : 1;
+  }
+
+  int stage = claim_stage(key, stages);
+  if (stage < 0) {
+    fprintf(stderr, "pipeline: all %d stages of %s are taken\n", stages, key);
+    return 1;
+  }
+
+  struct link in, out;
+  int has_in = stage > 0, has_out = stage < stages - 1;
+  if ((has_in && link_open(&in, key, stage - 1, 0, use_channel) != 0) ||
+      (has_out && link_open(&out, key, stage, 1, use_channel) != 0)) {
+    perror("link_open");
+    return 1;
+  }
+  int channel = (has_in ? in.ch : out.ch) != NULL;
+
+  int ok = 1;
+  long blocks = 0;
+  uint64_t h = 0;
+  if (!has_in) {
+    for (; blocks < BLOCKS && ok; blocks++) {
+      uint64_t *dst = link_reserve(&out);
+      for (long i = 0; i < BLOCK / 8; i++) {
+        dst[i] = block_word(blocks, i);
+      }
+      ok = link_commit(&out, BLOCK) == 0;
+    }
+  } else {
+    const uint64_t *src;
+    long len;
+    while ((src = link_next(&in, &len)) != NULL && ok) {
+      if (has_out) {
+        uint64_t *dst = link_reserve(&out);
+        for (long i = 0; i < len / 8; i++) {
+          dst[i] = src[i] + STEP;
+        }
+        ok = link_commit(&out, len) == 0;
+      } else {
+        for (long i = 0; i < len / 8; i++) {
+          h = fold(h, src[i]);
+        }
+      }
+      link_release(&in);
+      blocks++;
+    }
+  }
+
+  if (has_in) {
+    link_close(&in, 0);
+  }
+  if (has_out) {
+    link_close(&out, 1);
+  }
+
+  // The last stage runs until everyone upstream is done, so it cleans up
+  if (!has_out) {
+    ok = ok && blocks == BLOCKS && h == expected_checksum(BLOCKS, stages);
+    char path[128];
+    for (int i = 0; i < stages; i++) {
+      path_of(path, sizeof(path), key, i, "stage");
+      unlink(path);
+      path_of(path, sizeof(path), key, i, "fifo");
+      unlink(path);
+    }
+  }
+
+  printf("pipeline: stage=%d/%d mode=%s blocks=%ld ok=%s\n", stage, stages,
+         channel ? "channel" : "fifo", blocks, ok ? "yes" : "no");
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
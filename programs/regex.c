@@ -0,0 +1,172 @@
+// programs/regex.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+#define NUM_PATTERNS 4
+
+static uint32_t rng_state_re = 1122334455u;
+
+static int rand_int_re(void) {
+  uint32_t x = rng_state_re;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_re = x;
+  return (int)(x & 0x7fffffff);
+}
+
+// Backtracking matcher supporting ^ $ . [a-z] * + ? and literals.
+static int match_here(const char *re, const char *text);
+
+static const char *atom_end(const char *re) {
+  if (*re == '[') {
+    while (*re && *re != ']') {
+      re++;
+    }
+    return *re ? re + 1 : re;
+  }
+  return re + 1;
+}
+
+static int match_atom(const char *re, char c) {
+  if (c == '\0' || c == '\n') {
+    return 0;
+  }
+  if (*re == '.') {
+    return 1;
+  }
+  if (*re == '[') {
+    for (re++; *re && *re != ']'; re++) {
+      if (re[1] == '-' && re[2] && re[2] != ']') {
+        if (c >= re[0] && c <= re[2]) {
+          return 1;
+        }
+        re += 2;
+      } else if (*re == c) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+  return *re == c;
+}
+
+static int match_repeat(const char *atom, const char *rest, const char *text,
+                        int min) {
+  const char *t = text;
+  while (match_atom(atom, *t)) {
+    t++;
+  }
+  // greedy: try the longest run first
+  for (; t >= text + min; t--) {
+    if (match_here(rest, t)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int match_here(const char *re, const char *text) {
+  if (re[0] == '\0') {
+    return 1;
+  }
+  if (re[0] == '$' && re[1] == '\0') {
+    return *text == '\0' || *text == '\n';
+  }
+
+  const char *next = atom_end(re);
+  switch (*next) {
+  case '*':
+    return match_repeat(re, next + 1, text, 0);
+  case '+':
+    return match_repeat(re, next + 1, text, 1);
+  case '?':
+    if (match_atom(re, *text) && match_here(next + 1, text + 1)) {
+      return 1;
+    }
+    return match_here(next + 1, text);
+  default:
+    return match_atom(re, *text) && match_here(next, text + 1);
+  }
+}
+
+static int match(const char *re, const char *text) {
+  if (re[0] == '^') {
+    return match_here(re + 1, text);
+  }
+  do {
+    if (match_here(re, text)) {
+      return 1;
+    }
+  } while (*text != '\0' && *text++ != '\n');
+  return 0;
+}
+
+int entry(void) {
+  static const char *const levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+  static const char *const paths[] = {"/api/users", "/api/orders",
+                                      "/static/app.js", "/health"};
+  static const char *const patterns[NUM_PATTERNS] = {
+      "^ERROR", "status=5[0-9][0-9]", "path=/api/[a-z]+ ", "id=[0-9]*7$"};
+
+  const long LINES = 200000L * SCALE;
+  const int ROUNDS = 2;
+
+  char *text = (char *)malloc((size_t)LINES * 96);
+  const char **starts = (const char **)malloc(LINES * sizeof(char *));
+  if (!text || !starts) {
+    perror("malloc");
+    return 1;
+  }
+
+  // generate lines and tally the expected match counts
+  long expected[NUM_PATTERNS] = {0};
+  size_t pos = 0;
+  for (long i = 0; i < LINES; i++) {
+    int level = rand_int_re() % 4;
+    int path = rand_int_re() % 4;
+    int status = 200 + (rand_int_re() % 4) * 100;
+    int id = rand_int_re() % 1000000;
+
+    starts[i] = text + pos;
+    pos += (size_t)snprintf(text + pos, 96, "%s path=%s status=%d id=%d\n",
+                            levels[level], paths[path], status, id);
+
+    expected[0] += level == 3;
+    expected[1] += status == 500;
+    expected[2] += path < 2;
+    expected[3] += id % 10 == 7;
+  }
+
+  long found[NUM_PATTERNS] = {0};
+  for (int r = 0; r < ROUNDS; r++) {
+    memset(found, 0, sizeof(found));
+    for (long i = 0; i < LINES; i++) {
+      for (int p = 0; p < NUM_PATTERNS; p++) {
+        found[p] += match(patterns[p], starts[i]);
+      }
+    }
+  }
+
+  int ok = 1;
+  for (int p = 0; p < NUM_PATTERNS; p++) {
+    if (found[p] != expected[p]) {
+      ok = 0;
+    }
+  }
+
+  printf("regex: lines=%ld matches=%ld/%ld/%ld/%ld ok=%s\n", LINES, found[0],
+         found[1], found[2], found[3], ok ? "yes" : "no");
+
+  free(text);
+  free(starts);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
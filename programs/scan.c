@@ -0,0 +1,154 @@
+// programs/scan.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+// Resolved from the fluke runtime; the native build falls back to stdio.
+extern const void *fluke_map_file(const char *path, long *len, int *mapped)
+    __attribute__((weak));
+extern void fluke_unmap_file(const void *ptr, long len) __attribute__((weak));
+
+static uint32_t rng_state_scan = 31415926u;
+
+static int rand_int_scan(void) {
+  uint32_t x = rng_state_scan;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_scan = x;
+  return (int)(x & 0x7fffffff);
+}
+
+struct counts {
+  long lines;
+  long words;
+  long errors;
+};
+
+// Log-like input written through stdio, counted as it is generated.
+static int make_input(int fd, long n, struct counts *expect) {
+  static const char *const levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+  FILE *f = fdopen(fd, "w");
+  if (!f) {
+    close(fd);
+    return -1;
+  }
+
+  long pos = 0;
+  while (pos < n) {
+    int level = rand_int_scan() % 4;
+    int len = fprintf(f, "%08ld %s user=%d latency=%dus\n", expect->lines,
+                      levels[level], rand_int_scan() % 1000,
+                      rand_int_scan() % 100000);
+    pos += len;
+    expect->lines++;
+    expect->words += 4;
+    expect->errors += level == 3;
+  }
+
+  return fclose(f);
+}
+
+static const char *load_input(const char *path, long *len, int *mapped) {
+  *mapped = 0;
+  if (fluke_map_file) {
+    return fluke_map_file(path, len, mapped);
+  }
+
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *buf = (char *)malloc(*len > 0 ? *len : 1);
+  if (buf && fread(buf, 1, *len, f) != (size_t)*len) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  return buf;
+}
+
+static void release_input(const char *buf, long len) {
+  if (fluke_unmap_file) {
+    fluke_unmap_file(buf, len);
+  } else {
+    free((void *)buf);
+  }
+}
+
+static void count(const char *buf, long len, struct counts *out) {
+  int in_word = 0;
+  for (long i = 0; i < len; i++) {
+    char c = buf[i];
+    if (c == '\n') {
+      out->lines++;
+    }
+    if (c == ' ' || c == '\n') {
+      in_word = 0;
+    } else if (!in_word) {
+      in_word = 1;
+      out->words++;
+    }
+    if (c == 'E' && i + 5 <= len && memcmp(buf + i, "ERROR", 5) == 0) {
+      out->errors++;
+    }
+  }
+}
+
+int entry(void) {
+  const long N = (long)(8 << 20) * SCALE;
+  const int ROUNDS = 4;
+
+  // Concurrent instances share a pid under one loader, so the name must be
+  // unique per instance
+  char path[] = "/tmp/fluke_scan_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+
+  struct counts expect = {0, 0, 0};
+  if (make_input(fd, N, &expect) != 0) {
+    perror("make_input");
+    unlink(path);
+    return 1;
+  }
+
+  int ok = 1, mapped = 1;
+  long len = 0;
+  for (int r = 0; r < ROUNDS && ok; r++) {
+    int round_mapped;
+    const char *buf = load_input(path, &len, &round_mapped);
+    mapped &= round_mapped;
+    if (!buf) {
+      perror("load_input");
+      ok = 0;
+      break;
+    }
+
+    struct counts got = {0, 0, 0};
+    count(buf, len, &got);
+    ok = got.lines == expect.lines && got.words == expect.words &&
+         got.errors == expect.errors;
+    release_input(buf, len);
+  }
+
+  unlink(path);
+  printf("scan: bytes=%ld lines=%ld errors=%ld mapped=%s ok=%s\n", len,
+         expect.lines, expect.errors, mapped ? "yes" : "no",
+         ok ? "yes" : "no");
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
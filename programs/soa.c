@@ -0,0 +1,167 @@
+// programs/soa.c
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef SCALE
+#define SCALE 1
+#endif
+
+#define NUM_CATEGORIES 16
+#define NUM_REGIONS 8
+#define NUM_BUCKETS 64
+
+typedef struct {
+  int64_t *ts;
+  int32_t *price;
+  int32_t *qty;
+  uint8_t *category;
+  uint8_t *region;
+  size_t n;
+} Columns;
+
+typedef struct {
+  int64_t ts;
+  int32_t price;
+  int32_t qty;
+  uint8_t category;
+  uint8_t region;
+} Row;
+
+typedef struct {
+  int64_t revenue[NUM_CATEGORIES];
+  int64_t units[NUM_REGIONS];
+  int64_t histogram[NUM_BUCKETS];
+  int64_t max_order;
+} Report;
+
+static uint32_t rng_state_soa = 77777777u;
+
+static int rand_int_soa(void) {
+  uint32_t x = rng_state_soa;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_state_soa = x;
+  return (int)(x & 0x7fffffff);
+}
+
+// Column scans: revenue by category within a time window, units by region,
+// and a price histogram, each as its own pass over the relevant columns.
+static void analyze_columns(const Columns *c, int64_t lo, int64_t hi,
+                            Report *r) {
+  for (size_t i = 0; i < c->n; i++) {
+    if (c->ts[i] >= lo && c->ts[i] < hi) {
+      r->revenue[c->category[i]] += (int64_t)c->price[i] * c->qty[i];
+    }
+  }
+
+  for (size_t i = 0; i < c->n; i++) {
+    r->units[c->region[i]] += c->qty[i];
+  }
+
+  for (size_t i = 0; i < c->n; i++) {
+    r->histogram[(c->price[i] >> 10) & (NUM_BUCKETS - 1)]++;
+  }
+
+  for (size_t i = 0; i < c->n; i++) {
+    int64_t order = (int64_t)c->price[i] * c->qty[i];
+    if (order > r->max_order) {
+      r->max_order = order;
+    }
+  }
+}
+
+// Row-at-a-time reference used to validate the columnar results.
+static void analyze_rows(const Row *rows, size_t n, int64_t lo, int64_t hi,
+                         Report *r) {
+  for (size_t i = 0; i < n; i++) {
+    const Row *row = &rows[i];
+    int64_t order = (int64_t)row->price * row->qty;
+    if (row->ts >= lo && row->ts < hi) {
+      r->revenue[row->category] += order;
+    }
+    r->units[row->region] += row->qty;
+    r->histogram[(row->price >> 10) & (NUM_BUCKETS - 1)]++;
+    if (order > r->max_order) {
+      r->max_order = order;
+    }
+  }
+}
+
+static int reports_equal(const Report *a, const Report *b) {
+  for (int i = 0; i < NUM_CATEGORIES; i++) {
+    if (a->revenue[i] != b->revenue[i])
+      return 0;
+  }
+  for (int i = 0; i < NUM_REGIONS; i++) {
+    if (a->units[i] != b->units[i])
+      return 0;
+  }
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    if (a->histogram[i] != b->histogram[i])
+      return 0;
+  }
+  return a->max_order == b->max_order;
+}
+
+int entry(void) {
+  const size_t N = (size_t)1000000 * SCALE;
+  const int QUERIES = 8;
+
+  Columns c;
+  c.n = N;
+  c.ts = (int64_t *)malloc(N * sizeof(int64_t));
+  c.price = (int32_t *)malloc(N * sizeof(int32_t));
+  c.qty = (int32_t *)malloc(N * sizeof(int32_t));
+  c.category = (uint8_t *)malloc(N);
+  c.region = (uint8_t *)malloc(N);
+  Row *rows = (Row *)malloc(N * sizeof(Row));
+  if (!c.ts || !c.price || !c.qty || !c.category || !c.region || !rows) {
+    perror("malloc");
+    return 1;
+  }
+
+  int64_t t = 1700000000;
+  for (size_t i = 0; i < N; i++) {
+    t += rand_int_soa() % 5;
+    c.ts[i] = rows[i].ts = t;
+    c.price[i] = rows[i].price = rand_int_soa() % 65536;
+    c.qty[i] = rows[i].qty = 1 + rand_int_soa() % 20;
+    c.category[i] = rows[i].category =
+        (uint8_t)(rand_int_soa() % NUM_CATEGORIES);
+    c.region[i] = rows[i].region = (uint8_t)(rand_int_soa() % NUM_REGIONS);
+  }
+
+  // sliding time windows over the dataset
+  int ok = 1;
+  int64_t total = 0;
+  int64_t span = (t - 1700000000) / QUERIES;
+  for (int q = 0; q < QUERIES; q++) {
+    int64_t lo = 1700000000 + q * span / 2;
+    int64_t hi = lo + span * 4;
+
+    Report col = {{0}, {0}, {0}, 0};
+    Report row = {{0}, {0}, {0}, 0};
+    analyze_columns(&c, lo, hi, &col);
+    analyze_rows(rows, N, lo, hi, &row);
+
+    ok &= reports_equal(&col, &row);
+    for (int i = 0; i < NUM_CATEGORIES; i++) {
+      total += col.revenue[i];
+    }
+  }
+
+  printf("soa: rows=%zu queries=%d revenue=%lld ok=%s\n", N, QUERIES,
+         (long long)total, ok ? "yes" : "no");
+
+  free(c.ts);
+  free(c.price);
+  free(c.qty);
+  free(c.category);
+  free(c.region);
+  free(rows);
+  return ok ? 0 : 1;
+}
+
+int main(void) { return entry(); }
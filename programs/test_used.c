@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+// Globals kept alive with `used` are listed in llvm.used/llvm.compiler.used,
+// so bounds-check must leave them out of the merged data segments
+static int plain_int = 7;
+__attribute__((used)) static int used_int = 11;
+__attribute__((used)) static const char used_tag[] = "fluke-used";
+static const char plain_tag[] = "plain";
+__attribute__((used)) static long used_zero[4];
+static long plain_zero[4];
+
+void entry(void) {
+    printf("test_used: starting\n");
+
+    used_zero[1] = used_int;
+    plain_zero[2] = plain_int;
+
+    printf("test_used: plain_int = %d, used_int = %d\n", plain_int, used_int);
+    printf("test_used: tags = %s, %s\n", plain_tag, used_tag);
+    printf("test_used: zero = %ld, %ld\n", used_zero[1], plain_zero[2]);
+
+    int ok = used_zero[1] == 11 && plain_zero[2] == 7;
+    printf("test_used: %s\n", ok ? "PASS" : "FAIL");
+}
+
+int main() {
+    entry();
+}
@@ -4,11 +4,26 @@ SCRIPT="./run_benchmarks.py"
 CONCURRENCIES=(1 2 4 8 16 32 64 128 256)
 TRIALS=5
 
+# No huge page sweep: the standalone loader ignores FLUKE_HUGEPAGES, so both
+# settings would measure the same thing
 for c in "${CONCURRENCIES[@]}"; do
-    prefix="result${c}"
     python3 "$SCRIPT" \
         --trials="$TRIALS" \
         --concurrency="$c" \
-        --out-prefix="$prefix"
+        --out-prefix="result${c}"
     echo
 done
+
+python3 "$SCRIPT" \
+    --mode=throughput \
+    --trials="$TRIALS" \
+    --out-prefix="throughput"
+echo
+
+# Per-instance latency at every concurrency level, optionally pinned with
+# CPUS="0-7"
+python3 ./run_scaling.py \
+    --trials="$TRIALS" \
+    --concurrency "${CONCURRENCIES[@]}" \
+    --cpus="${CPUS:-}" \
+    --out-prefix="scaling"
@@ -5,8 +5,13 @@ import os
 import time
 from datetime import datetime
 import argparse
+import threading
 
-PROGRAMS = ["treap", "sorting", "matmul", "bsearch", "memthrash"]
+PROGRAMS = ["treap", "sorting", "matmul", "bsearch", "memthrash",
+            "hashtable", "json", "lz", "regex", "soa", "scan"]
+# Need a loader providing __fluke_thread_create, so only run with --threads
+THREAD_PROGRAMS = ["par_sorting", "par_matmul"]
+THROUGHPUT_PROGRAMS = ["request", "hashtable", "json"]
 PROGRAM_DIR = "programs"
 TIME_CMD = "/usr/bin/time"  
 LOADER = "./loader/target/release/fixed_loader"
@@ -45,7 +50,77 @@ def parse_time_output(stderr_text: str):
     return data
 
 
-def run_batch_concurrent(commands):
+def descendant_pids(pid: int):
+    """All live descendants of pid, found through /proc/<pid>/task/*/children."""
+    pids = []
+    stack = [pid]
+    while stack:
+        cur = stack.pop()
+        try:
+            for tid in os.listdir(f"/proc/{cur}/task"):
+                with open(f"/proc/{cur}/task/{tid}/children") as f:
+                    children = [int(c) for c in f.read().split()]
+                pids.extend(children)
+                stack.extend(children)
+        except (FileNotFoundError, ProcessLookupError, PermissionError):
+            continue
+    return pids
+
+
+def read_huge_kb(pid: int):
+    """THP plus hugetlbfs memory mapped by pid, in kB."""
+    total = 0
+    try:
+        with open(f"/proc/{pid}/smaps_rollup") as f:
+            for line in f:
+                if line.startswith(("AnonHugePages:", "Shared_Hugetlb:",
+                                    "Private_Hugetlb:")):
+                    total += int(line.split()[1])
+    except (FileNotFoundError, ProcessLookupError, PermissionError):
+        pass
+    return total
+
+
+class HugePageSampler:
+    """Polls huge page usage of the benchmarked processes.
+
+    Each poll walks /proc for every process, so it runs rarely enough that
+    the sampler stays out of the timings it shares a machine with.
+    """
+
+    def __init__(self, procs, interval=0.25):
+        self.procs = procs
+        self.interval = interval
+        self.peak_kb = 0
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+
+    def _run(self):
+        while not self._stop.is_set():
+            total = 0
+            for p in self.procs:
+                for pid in [p.pid] + descendant_pids(p.pid):
+                    total += read_huge_kb(pid)
+            self.peak_kb = max(self.peak_kb, total)
+            self._stop.wait(self.interval)
+
+    def __enter__(self):
+        self._thread.start()
+        return self
+
+    def __exit__(self, *exc):
+        self._stop.set()
+        self._thread.join()
+
+
+def loader_env(hugepages: str):
+    # libfluke honours FLUKE_HUGEPAGES; the standalone loader ignores it
+    env = dict(os.environ)
+    env["FLUKE_HUGEPAGES"] = "0" if hugepages == "off" else "1"
+    return env
+
+
+def run_batch_concurrent(commands, env=None):
     """
     Exec variant: Spawns N processes sequentially.
     Returns: Aggregated stats (Sum of CPU/RSS, Max Wall Time).
@@ -60,12 +135,14 @@ def run_batch_concurrent(commands):
             stdout=subprocess.PIPE,
             stderr=subprocess.PIPE,
             text=True,
+            env=env,
         )
         procs.append(p)
 
-    for p in procs:
-        _, stderr = p.communicate()
-        stderrs.append(stderr)
+    with HugePageSampler(procs) as sampler:
+        for p in procs:
+            _, stderr = p.communicate()
+            stderrs.append(stderr)
     end_ns = time.perf_counter_ns()
 
     agg = {
@@ -76,7 +153,8 @@ def run_batch_concurrent(commands):
         "max_rss_kb": 0,
         "minor_faults": 0,
         "major_faults": 0,
-        "exit_code": 0
+        "exit_code": 0,
+        "huge_kb": sampler.peak_kb,
     }
 
     for i, p in enumerate(procs):
@@ -91,7 +169,7 @@ def run_batch_concurrent(commands):
     return agg
 
 
-def run_batch_simple(commands):
+def run_batch_simple(commands, env=None):
     """
     Lib/Clam variant: Runs a single Loader process with many arguments.
     Returns: Stats of that single loader process.
@@ -105,12 +183,16 @@ def run_batch_simple(commands):
         stdout=subprocess.PIPE,
         stderr=subprocess.PIPE,
         text=True,
+        env=env,
     )
-    _, stderr = p.communicate()
+    with HugePageSampler([p]) as sampler:
+        stdout, stderr = p.communicate()
     end_ns = time.perf_counter_ns()
 
     parsed = parse_time_output(stderr)
+    parsed["stdout"] = stdout
     parsed["exit_code"] = p.returncode
+    parsed["huge_kb"] = sampler.peak_kb
     parsed["wall_time"] = (end_ns - start_ns) / 1e9
     
     if p.returncode != 0:
@@ -130,8 +212,8 @@ def get_benchmark_config(prog: str, variant: str, concurrency: int):
         cmd = [LOADER] + [so_path] * concurrency
         return [cmd], [LOADER, so_path]
 
-    elif variant == "clam":
-        so_path = os.path.join(PROGRAM_DIR, f"{prog}_clam.so")
+    elif variant in ("clam", "lib_trap", "clam_trap", "lib_wo", "clam_wo"):
+        so_path = os.path.join(PROGRAM_DIR, f"{prog}_{variant}.so")
         cmd = [LOADER] + [so_path] * concurrency
         return [cmd], [LOADER, so_path]
 
@@ -139,30 +221,115 @@ def get_benchmark_config(prog: str, variant: str, concurrency: int):
         raise ValueError(f"Unknown variant: {variant}")
 
 
+def run_throughput(args, timestamp):
+    """
+    Throughput mode: runs many short-lived instances back to back and reports
+    instances per second, overall and per core of CPU time consumed.
+    """
+    out_csv = f"{args.out_prefix}_throughput_{timestamp}.csv"
+    fieldnames = [
+        "program", "variant", "instances", "concurrency",
+        "exit_code", "avg_wall_time", "avg_cpu_time", "avg_minor_faults",
+        "instances_per_sec", "instances_per_sec_per_core"
+    ]
+
+    with open(out_csv, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fieldnames)
+        writer.writeheader()
+
+        for prog in THROUGHPUT_PROGRAMS:
+            for variant in ["exec", "lib", "clam"]:
+                _, to_check = get_benchmark_config(prog, variant, 1)
+                if any(not os.path.exists(p) for p in to_check):
+                    print(f"[WARN] Missing resources for {prog} {variant}, skipping.")
+                    continue
+
+                print(f"[+] Throughput {prog} ({variant}) instances={args.instances}")
+
+                env = loader_env(args.hugepages)
+                collected = []
+                for trial in range(1, args.trials + 1):
+                    print(f"    Trial {trial}/{args.trials}...")
+                    if variant == "exec":
+                        # processes are spawned in waves of `concurrency`
+                        waves = []
+                        remaining = args.instances
+                        while remaining > 0:
+                            n = min(remaining, args.concurrency)
+                            commands, _ = get_benchmark_config(prog, variant, n)
+                            waves.append(run_batch_concurrent(commands, env))
+                            remaining -= n
+                    else:
+                        # one loader process runs and recycles every instance
+                        commands, _ = get_benchmark_config(prog, variant, args.instances)
+                        waves = [run_batch_simple(commands, env)]
+
+                    collected.append({
+                        "wall_time": sum(w["wall_time"] for w in waves),
+                        "cpu_time": sum(w["user_time"] + w["sys_time"] for w in waves),
+                        "minor_faults": sum(w["minor_faults"] for w in waves),
+                        "exit_code": max(w["exit_code"] for w in waves),
+                    })
+
+                def avg(key):
+                    return sum(r[key] for r in collected) / len(collected)
+
+                wall, cpu = avg("wall_time"), avg("cpu_time")
+                writer.writerow({
+                    "program": prog,
+                    "variant": variant,
+                    "instances": args.instances,
+                    "concurrency": args.concurrency,
+                    "exit_code": max(r["exit_code"] for r in collected),
+                    "avg_wall_time": wall,
+                    "avg_cpu_time": cpu,
+                    "avg_minor_faults": avg("minor_faults"),
+                    "instances_per_sec": args.instances / wall if wall else 0.0,
+                    "instances_per_sec_per_core": args.instances / cpu if cpu else 0.0,
+                })
+
+    print(f"[+] Results written to {out_csv}")
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--trials", type=int, default=5)
     parser.add_argument("--concurrency", type=int, default=8)
     parser.add_argument("--out-prefix", type=str, default="results")
+    parser.add_argument("--hugepages", choices=["auto", "off"], default="auto",
+                        help="Ask libfluke for 2 MiB-aligned THP regions")
+    parser.add_argument("--mode", choices=["batch", "throughput"], default="batch")
+    parser.add_argument("--instances", type=int, default=4096,
+                        help="Instances per trial in throughput mode")
+    parser.add_argument("--threads", action="store_true",
+                        help="Also run THREAD_PROGRAMS")
     args = parser.parse_args()
 
     timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    if args.mode == "throughput":
+        run_throughput(args, timestamp)
+        return
+
     out_csv = f"{args.out_prefix}_{timestamp}.csv"
 
     fieldnames = [
         "program", "variant", "concurrency",
         "exit_code", "avg_wall_time", "avg_user_time", "avg_sys_time",
         "avg_voluntary_ctx", "avg_involuntary_ctx", "avg_max_rss_kb",
-        "avg_minor_faults", "avg_major_faults"
+        "avg_minor_faults", "avg_major_faults", "hugepages",
+        "avg_huge_kb"
     ]
 
     with open(out_csv, "w", newline="") as f:
         writer = csv.DictWriter(f, fieldnames=fieldnames)
         writer.writeheader()
 
-        variants = ["exec", "lib", "clam"]
+        # Masked, trapping and write-only checks run side by side
+        variants = ["exec", "lib", "lib_trap", "clam", "clam_trap",
+                    "lib_wo", "clam_wo"]
 
-        for prog in PROGRAMS:
+        programs = PROGRAMS + (THREAD_PROGRAMS if args.threads else [])
+        for prog in programs:
             for variant in variants:
                 commands, to_check = get_benchmark_config(prog, variant, args.concurrency)
 
@@ -175,10 +342,11 @@ def main():
                 collected = []
                 for trial in range(1, args.trials + 1):
                     print(f"    Trial {trial}/{args.trials}...")
+                    env = loader_env(args.hugepages)
                     if variant == "exec":
-                        res = run_batch_concurrent(commands)
+                        res = run_batch_concurrent(commands, env)
                     else:
-                        res = run_batch_simple(commands)
+                        res = run_batch_simple(commands, env)
                     collected.append(res)
 
                 def avg(key):
@@ -197,6 +365,8 @@ def main():
                     "avg_max_rss_kb": avg("max_rss_kb"),
                     "avg_minor_faults": avg("minor_faults"),
                     "avg_major_faults": avg("major_faults"),
+                    "hugepages": args.hugepages,
+                    "avg_huge_kb": avg("huge_kb"),
                 }
 
                 writer.writerow(avg_row)
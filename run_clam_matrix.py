@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+import subprocess
+import csv
+import os
+import itertools
+import time
+from datetime import datetime
+import argparse
+
+from run_benchmarks import (PROGRAMS, PROGRAM_DIR, TIME_CMD, LOADER,
+                            parse_time_output, run_batch_simple, loader_env)
+
+DOMAINS = ["int", "zones", "oct", "boxes", "pk"]
+TRACKS = ["num", "mem"]
+INTER = ["on", "off"]
+MATRIX_DIR = os.path.join(PROGRAM_DIR, "matrix")
+
+CLAM = "clam/py/clam.py"
+OPT = "opt-14"
+LINK = "llvm-link-14"
+CLANG = "clang-14"
+CFLAGS = ["-O3", "-fPIC", "-Wall", "-Wextra"]
+LDFLAGS = ["-shared", "-Wl,-z,now"]
+STUBS = "stubs.bc"
+PATCH_PLUGIN = "./patch_entry.so"
+
+
+def parse_clam_log(log_path: str):
+    """Safe/total check counts, as reported by print_failures.sh."""
+    counts = {"safe": 0, "warning": 0, "error": 0}
+    keys = {"Number of total safe checks": "safe",
+            "Number of total warning checks": "warning",
+            "Number of total error checks": "error"}
+    try:
+        with open(log_path) as f:
+            for line in f:
+                for text, key in keys.items():
+                    if text in line and counts[key] == 0:
+                        try: counts[key] = int(line.split()[0])
+                        except ValueError: pass
+    except FileNotFoundError:
+        pass
+    return counts["safe"], sum(counts.values())
+
+
+def run_analysis(inlined: str, out_bc: str, flags, timeout: int):
+    """Runs clam under /usr/bin/time; returns (exit, wall, peak RSS kB)."""
+    log_path = out_bc + ".log"
+    cmd = [TIME_CMD, "-v", CLAM] + flags + [inlined, "-o", out_bc]
+
+    start_ns = time.perf_counter_ns()
+    with open(log_path, "w") as log:
+        try:
+            p = subprocess.run(cmd, stdout=log, stderr=subprocess.PIPE,
+                               text=True, timeout=timeout)
+            code, stderr = p.returncode, p.stderr
+        except subprocess.TimeoutExpired as e:
+            code, stderr = -1, e.stderr or ""
+            if isinstance(stderr, bytes):
+                stderr = stderr.decode(errors="replace")
+    wall = (time.perf_counter_ns() - start_ns) / 1e9
+
+    # clam's own stderr shares the log with time's report
+    with open(log_path, "a") as log:
+        log.write(stderr)
+
+    return code, wall, parse_time_output(stderr)["max_rss_kb"]
+
+
+def build_shared_object(clam_bc: str, so_path: str):
+    """Same steps as the Makefile's _clam.so rules."""
+    base = clam_bc[:-len(".bc")]
+    stubbed, patched, optimized = (f"{base}_{s}.bc" for s in
+                                   ("stubbed", "patched", "optimized"))
+
+    ids = subprocess.run(["python3", "extract_safe_ids.py", clam_bc + ".log"],
+                         capture_output=True, text=True).stdout.strip()
+    env = dict(os.environ, VERIFIED_IDS=ids)
+
+    steps = [
+        ([LINK, clam_bc, STUBS, "-o", stubbed], None),
+        ([OPT, f"-load-pass-plugin={PATCH_PLUGIN}", "-passes=patch-entry",
+          stubbed, "-o", patched], env),
+        ([OPT, "-O3", patched, "-o", optimized], None),
+        ([CLANG] + CFLAGS + LDFLAGS + [optimized, "-o", so_path], None),
+    ]
+    for cmd, step_env in steps:
+        if subprocess.run(cmd, env=step_env).returncode != 0:
+            return False
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Clam analysis time, memory and precision across domains")
+    parser.add_argument("--trials", type=int, default=3,
+                        help="Runs of each resulting _clam.so")
+    parser.add_argument("--out-prefix", type=str, default="clam_matrix")
+    parser.add_argument("--programs", nargs="+", default=PROGRAMS)
+    parser.add_argument("--domains", nargs="+", default=DOMAINS)
+    parser.add_argument("--tracks", nargs="+", default=TRACKS)
+    parser.add_argument("--inter", nargs="+", choices=INTER, default=INTER)
+    parser.add_argument("--timeout", type=int, default=1800,
+                        help="Analysis timeout in seconds")
+    args = parser.parse_args()
+
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    out_csv = f"{args.out_prefix}_{timestamp}.csv"
+    os.makedirs(MATRIX_DIR, exist_ok=True)
+
+    fieldnames = [
+        "program", "domain", "track", "inter",
+        "analysis_exit_code", "analysis_wall_time", "analysis_max_rss_kb",
+        "safe_checks", "total_checks", "proven_ratio",
+        "exit_code", "avg_wall_time", "avg_user_time"
+    ]
+
+    with open(out_csv, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fieldnames)
+        writer.writeheader()
+
+        for prog in args.programs:
+            inlined = os.path.join(PROGRAM_DIR, f"{prog}_inlined.bc")
+            if subprocess.run(["make", inlined, STUBS]).returncode != 0:
+                print(f"[WARN] Could not build {inlined}, skipping.")
+                continue
+
+            for dom, track, inter in itertools.product(
+                    args.domains, args.tracks, args.inter):
+                tag = f"{prog}_{dom}_{track}_{inter}"
+                clam_bc = os.path.join(MATRIX_DIR, f"{tag}_clam.bc")
+                so_path = os.path.join(MATRIX_DIR, f"{tag}_clam.so")
+
+                flags = [f"--crab-track={track}", f"--crab-dom={dom}",
+                         "--crab-check=assert", "--crab-opt=add-invariants",
+                         "--crab-opt-invariants-loc=all"]
+                if inter == "on":
+                    flags.append("--crab-inter")
+
+                print(f"[+] Analyzing {prog} dom={dom} track={track} inter={inter}")
+                code, wall, rss = run_analysis(inlined, clam_bc, flags,
+                                               args.timeout)
+                safe, total = parse_clam_log(clam_bc + ".log")
+
+                row = {
+                    "program": prog, "domain": dom, "track": track,
+                    "inter": inter, "analysis_exit_code": code,
+                    "analysis_wall_time": wall, "analysis_max_rss_kb": rss,
+                    "safe_checks": safe, "total_checks": total,
+                    "proven_ratio": safe / total if total else 0.0,
+                    "exit_code": "", "avg_wall_time": "", "avg_user_time": "",
+                }
+
+                if code == 0 and build_shared_object(clam_bc, so_path):
+                    collected = []
+                    for trial in range(1, args.trials + 1):
+                        print(f"    Trial {trial}/{args.trials}...")
+                        collected.append(run_batch_simple([[LOADER, so_path]],
+                                                          loader_env("auto")))
+                    row["exit_code"] = max(r["exit_code"] for r in collected)
+                    row["avg_wall_time"] = (sum(r["wall_time"] for r in collected)
+                                            / len(collected))
+                    row["avg_user_time"] = (sum(r["user_time"] for r in collected)
+                                            / len(collected))
+                else:
+                    print(f"[WARN] No shared object for {tag}")
+
+                writer.writerow(row)
+                f.flush()
+
+    print(f"[+] Results written to {out_csv}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+import csv
+import os
+import re
+from datetime import datetime
+import argparse
+
+from run_benchmarks import (PROGRAM_DIR, LOADER, loader_env,
+                            run_batch_concurrent, run_batch_simple)
+
+PROG = "pipeline"
+STAGES = [2, 3, 4]
+# exec: one process per stage over FIFOs
+# <variant>_fifo: stages in one loader, blocks through host FIFOs
+# <variant>_channel: stages in one loader, blocks through shared channels
+CONFIGS = ["exec", "lib_fifo", "lib_channel", "clam_fifo", "clam_channel"]
+BLOCK_BYTES = 64 << 10
+BLOCKS = 4096
+# Each stage reports the transport it actually used
+MODE_RE = re.compile(r"\bmode=(\w+)")
+
+
+def pipeline_env(config: str, stages: int, key: str, hugepages: str):
+    env = loader_env(hugepages)
+    env["FLUKE_PIPELINE_STAGES"] = str(stages)
+    env["FLUKE_PIPELINE_KEY"] = key
+    env["FLUKE_PIPELINE"] = "fifo" if config.endswith("_fifo") else "channel"
+    # The loader only maps channels it was told to grant
+    env["FLUKE_CHANNELS"] = ",".join(
+        f"{PROG}.{key}.{hop}" for hop in range(stages - 1))
+    return env
+
+
+def run_pipeline(config: str, stages: int, key: str, hugepages: str):
+    env = pipeline_env(config, stages, key, hugepages)
+    if config == "exec":
+        exe = os.path.join(PROGRAM_DIR, f"{PROG}_exec")
+        return run_batch_concurrent([[exe] for _ in range(stages)], env)
+
+    variant = config.rsplit("_", 1)[0]
+    so_path = os.path.join(PROGRAM_DIR, f"{PROG}_{variant}.so")
+    return run_batch_simple([[LOADER] + [so_path] * stages], env)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Multi-guest pipeline over shared channels vs host I/O")
+    parser.add_argument("--trials", type=int, default=5)
+    parser.add_argument("--out-prefix", type=str, default="pipeline")
+    parser.add_argument("--stages", type=int, nargs="+", default=STAGES)
+    parser.add_argument("--configs", nargs="+", choices=CONFIGS,
+                        default=CONFIGS)
+    parser.add_argument("--scale", type=int, default=1,
+                        help="SCALE the programs were built with")
+    parser.add_argument("--hugepages", choices=["auto", "off"], default="auto")
+    args = parser.parse_args()
+
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    out_csv = f"{args.out_prefix}_{timestamp}.csv"
+    total_mb = BLOCKS * args.scale * BLOCK_BYTES / (1 << 20)
+
+    fieldnames = [
+        "config", "stages", "trials", "exit_code", "avg_wall_time",
+        "avg_user_time", "avg_sys_time", "avg_voluntary_ctx", "mb_per_sec"
+    ]
+
+    with open(out_csv, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fieldnames)
+        writer.writeheader()
+
+        for config in args.configs:
+            if config == "exec":
+                needed = [os.path.join(PROGRAM_DIR, f"{PROG}_exec")]
+            else:
+                variant = config.rsplit("_", 1)[0]
+                needed = [LOADER,
+                          os.path.join(PROGRAM_DIR, f"{PROG}_{variant}.so")]
+            if any(not os.path.exists(p) for p in needed):
+                print(f"[WARN] Missing resources for {config}, skipping.")
+                continue
+
+            for stages in args.stages:
+                print(f"[+] Pipeline {config} stages={stages}")
+
+                collected = []
+                fallback = None
+                for trial in range(1, args.trials + 1):
+                    print(f"    Trial {trial}/{args.trials}...")
+                    # A fresh key per run, so stale stage claims never collide
+                    key = f"{os.getpid()}-{config}-{stages}-{trial}"
+                    res = run_pipeline(config, stages, key, args.hugepages)
+                    # Stages fall back to FIFOs when the loader has no
+                    # channel hostcalls; those runs would not measure channels
+                    modes = set(MODE_RE.findall(res.get("stdout", "")))
+                    if config.endswith("_channel") and modes != {"channel"}:
+                        fallback = ",".join(sorted(modes)) or "none"
+                        break
+                    collected.append(res)
+
+                if fallback:
+                    print(f"[WARN] {config} ran with mode={fallback}, "
+                          "skipping.")
+                    continue
+
+                n = len(collected)
+                wall = sum(r["wall_time"] for r in collected) / n
+                writer.writerow({
+                    "config": config,
+                    "stages": stages,
+                    "trials": n,
+                    "exit_code": max(r["exit_code"] for r in collected),
+                    "avg_wall_time": wall,
+                    "avg_user_time":
+                        sum(r["user_time"] for r in collected) / n,
+                    "avg_sys_time": sum(r["sys_time"] for r in collected) / n,
+                    "avg_voluntary_ctx":
+                        sum(r["voluntary_ctx"] for r in collected) / n,
+                    "mb_per_sec": total_mb / wall if wall else 0.0,
+                })
+                f.flush()
+
+    print(f"[+] Results written to {out_csv}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+import subprocess
+import csv
+import math
+import os
+import tempfile
+import time
+from datetime import datetime
+import argparse
+
+from run_benchmarks import PROGRAMS, PROGRAM_DIR, LOADER, loader_env
+
+CONCURRENCIES = [1, 2, 4, 8, 16, 32, 64, 128, 256]
+VARIANTS = ["exec", "lib", "clam"]
+ENTRY_TIMES_LIB = "./entry_times.so"
+
+
+def parse_cpus(spec: str):
+    """'0-3,8,10-11' -> [0, 1, 2, 3, 8, 10, 11]"""
+    cpus = []
+    for part in spec.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        if "-" in part:
+            lo, hi = part.split("-", 1)
+            cpus.extend(range(int(lo), int(hi) + 1))
+        else:
+            cpus.append(int(part))
+    return cpus
+
+
+def percentile(sorted_vals, pct: float):
+    """Nearest-rank percentile of an ascending list."""
+    if not sorted_vals:
+        return 0.0
+    rank = max(1, math.ceil(pct / 100.0 * len(sorted_vals)))
+    return sorted_vals[min(rank, len(sorted_vals)) - 1]
+
+
+def read_entry_times(path: str):
+    times = []
+    try:
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) == 2:
+                    times.append((int(parts[0]), int(parts[1])))
+    except FileNotFoundError:
+        pass
+    return times
+
+
+def run_level(prog: str, variant: str, concurrency: int, cpus, hugepages: str):
+    """
+    Launches `concurrency` instances and returns the batch start time, exit
+    code and each instance's (start_ns, end_ns) entry window.
+    """
+    fd, times_path = tempfile.mkstemp(prefix="fluke_times_")
+    os.close(fd)
+
+    env = loader_env(hugepages)
+    env["FLUKE_ENTRY_TIMES"] = times_path
+
+    # Exec workers are pinned round-robin. The loader has no per-instance
+    # pinning, so its process is confined to the whole set instead.
+    def pin(cpu_set):
+        return (lambda: os.sched_setaffinity(0, cpu_set)) if cpu_set else None
+
+    start_ns = time.monotonic_ns()
+    procs = []
+    if variant == "exec":
+        env["LD_PRELOAD"] = ENTRY_TIMES_LIB
+        exe = os.path.join(PROGRAM_DIR, f"{prog}_exec")
+        for i in range(concurrency):
+            cpu_set = {cpus[i % len(cpus)]} if cpus else None
+            procs.append(subprocess.Popen([exe], stdout=subprocess.DEVNULL,
+                                          env=env, preexec_fn=pin(cpu_set)))
+    else:
+        so_path = os.path.join(PROGRAM_DIR, f"{prog}_{variant}.so")
+        procs.append(subprocess.Popen([LOADER] + [so_path] * concurrency,
+                                      stdout=subprocess.DEVNULL, env=env,
+                                      preexec_fn=pin(set(cpus) if cpus else None)))
+
+    exit_code = 0
+    for p in procs:
+        p.wait()
+        if p.returncode != 0:
+            exit_code = p.returncode
+    end_ns = time.monotonic_ns()
+
+    times = read_entry_times(times_path)
+    os.unlink(times_path)
+    return start_ns, end_ns, exit_code, times
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Per-instance latency percentiles across concurrency levels")
+    parser.add_argument("--trials", type=int, default=3)
+    parser.add_argument("--out-prefix", type=str, default="scaling")
+    parser.add_argument("--programs", nargs="+", default=PROGRAMS)
+    parser.add_argument("--variants", nargs="+", default=VARIANTS)
+    parser.add_argument("--concurrency", type=int, nargs="+",
+                        default=CONCURRENCIES)
+    parser.add_argument("--cpus", type=str, default="",
+                        help="Cores to pin workers to, e.g. 0-7,16-23")
+    parser.add_argument("--hugepages", choices=["auto", "off"], default="auto")
+    args = parser.parse_args()
+
+    cpus = parse_cpus(args.cpus)
+    allowed = os.sched_getaffinity(0)
+    if any(c not in allowed for c in cpus):
+        print(f"[WARN] Ignoring cores outside {sorted(allowed)}")
+        cpus = [c for c in cpus if c in allowed]
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    out_csv = f"{args.out_prefix}_{timestamp}.csv"
+
+    fieldnames = [
+        "program", "variant", "concurrency", "cores", "trials", "instances",
+        "exit_code", "throughput_per_sec",
+        "p50_latency_ms", "p90_latency_ms", "p99_latency_ms", "max_latency_ms",
+        "p50_completion_ms", "p99_completion_ms", "max_completion_ms"
+    ]
+
+    with open(out_csv, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fieldnames)
+        writer.writeheader()
+
+        for prog in args.programs:
+            for variant in args.variants:
+                if variant == "exec":
+                    needed = [os.path.join(PROGRAM_DIR, f"{prog}_exec"),
+                              ENTRY_TIMES_LIB]
+                else:
+                    needed = [LOADER,
+                              os.path.join(PROGRAM_DIR, f"{prog}_{variant}.so")]
+                if any(not os.path.exists(p) for p in needed):
+                    print(f"[WARN] Missing resources for {prog} {variant}, skipping.")
+                    continue
+
+                for concurrency in args.concurrency:
+                    print(f"[+] Scaling {prog} ({variant}) concurrency={concurrency}")
+
+                    latencies, completions = [], []
+                    batch_secs, exit_code = 0.0, 0
+                    for trial in range(1, args.trials + 1):
+                        print(f"    Trial {trial}/{args.trials}...")
+                        start, end, code, times = run_level(
+                            prog, variant, concurrency, cpus, args.hugepages)
+                        if code != 0:
+                            exit_code = code
+                            print(f"[WARN] Exit code {code}")
+                        if len(times) != concurrency:
+                            print(f"[WARN] {len(times)}/{concurrency} instances "
+                                  f"reported entry times")
+                        latencies += [(e - s) / 1e6 for s, e in times]
+                        completions += [(e - start) / 1e6 for _, e in times]
+                        batch_secs += (end - start) / 1e9
+
+                    latencies.sort()
+                    completions.sort()
+                    writer.writerow({
+                        "program": prog,
+                        "variant": variant,
+                        "concurrency": concurrency,
+                        "cores": len(cpus) if cpus else os.cpu_count(),
+                        "trials": args.trials,
+                        "instances": len(latencies),
+                        "exit_code": exit_code,
+                        "throughput_per_sec":
+                            len(latencies) / batch_secs if batch_secs else 0.0,
+                        "p50_latency_ms": percentile(latencies, 50),
+                        "p90_latency_ms": percentile(latencies, 90),
+                        "p99_latency_ms": percentile(latencies, 99),
+                        "max_latency_ms": latencies[-1] if latencies else 0.0,
+                        "p50_completion_ms": percentile(completions, 50),
+                        "p99_completion_ms": percentile(completions, 99),
+                        "max_completion_ms":
+                            completions[-1] if completions else 0.0,
+                    })
+                    f.flush()
+
+    print(f"[+] Results written to {out_csv}")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,19 +1,514 @@
 #include "runtime.h"
 
-BOUNDS_FN_ATTR const void *__bounds_check(const void *ptr, long size) {
-  int base_ok = (long)process_base <= (long)ptr;
-  int limit_ok = (long)process_limit >= (long)ptr + size;
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+BOUNDS_FN_ATTR const void *__bounds_check(const void *ptr, long size, long id) {
+  // Crab proves accesses against the reservation, so a proven access past
+  // the committed limit faults in the reserved tail rather than escaping.
+  long limit = FLUKE_LIMIT;
+  __CRAB_assume(limit == FLUKE_LIMIT_MAX);
+
+  int base_ok = FLUKE_BASE <= (long)ptr;
+  int limit_ok = limit >= (long)ptr + size;
 
   __CRAB_assert(base_ok);
   __CRAB_assert(limit_ok);
 
+#ifdef FLUKE_TRAP
+  if (unlikely(!(base_ok & limit_ok))) {
+    __bounds_violation(ptr, size, id);
+  }
+
+  return ptr;
+#else
+  (void)id;
+#ifdef FLUKE_STATS
+  if (unlikely(!(base_ok & limit_ok))) {
+    FLUKE_STATS_ADD(violations, 1);
+  }
+#endif
   long mask = -(base_ok & limit_ok);
-  long safe = ((long)ptr & mask) | ((long)process_base & ~mask);
+  long safe = ((long)ptr & mask) | (FLUKE_BASE & ~mask);
 
   return (const void *)safe;
+#endif
+}
+
+BOUNDS_FN_ATTR long __bounds_check_len(const void *ptr, long len, long id) {
+  long limit = FLUKE_LIMIT;
+  __CRAB_assume(limit == FLUKE_LIMIT_MAX);
+
+  int base_ok = FLUKE_BASE <= (long)ptr;
+  int limit_ok = (len >= 0) & (limit - (long)ptr >= len);
+
+  __CRAB_assert(base_ok);
+  __CRAB_assert(limit_ok);
+
+#ifdef FLUKE_TRAP
+  if (unlikely(!(base_ok & limit_ok))) {
+    __bounds_violation(ptr, len, id);
+  }
+
+  return len;
+#else
+  (void)id;
+#ifdef FLUKE_STATS
+  if (unlikely(!(base_ok & limit_ok))) {
+    FLUKE_STATS_ADD(violations, 1);
+  }
+#endif
+  return len & -(long)(base_ok & limit_ok);
+#endif
 }
 
 BOUNDS_FN_ATTR void __bounds_assume(const void *ptr, long size) {
-  __CRAB_assume((long)process_base <= (long)ptr);
-  __CRAB_assume((long)process_limit >= (long)ptr + size);
+  __CRAB_assume(FLUKE_BASE <= (long)ptr);
+  __CRAB_assume(FLUKE_LIMIT_MAX >= (long)ptr + size);
+}
+
+#ifdef FLUKE_GROWABLE
+// Tells the loader it may grow process_limit while the guest runs
+__attribute__((used, section(".fluke"))) const long __fluke_growable = 1;
+#endif
+
+#ifdef FLUKE_FIXED_BASE
+// The loader compares these against its placement before entering
+__attribute__((used, section(".fluke"))) const long __fluke_fixed_base =
+    FLUKE_BASE;
+__attribute__((used, section(".fluke"))) const long __fluke_fixed_limit =
+    FLUKE_LIMIT;
+
+// Refuse to run if a loader without that check placed us elsewhere
+__attribute__((constructor)) static void fluke_check_placement(void) {
+  if ((long)process_base != FLUKE_BASE ||
+      FLUKE_RESERVED_LIMIT != FLUKE_LIMIT) {
+    fprintf(stderr, "fluke: built for [%#lx, %#lx), placed at [%p, %#lx)\n",
+            FLUKE_BASE, FLUKE_LIMIT, process_base, FLUKE_RESERVED_LIMIT);
+    abort();
+  }
+}
+#endif
+
+COLD_FN_ATTR void __bounds_violation(const void *ptr, long size, long id) {
+  fprintf(stderr, "fluke: bounds violation at check %ld (ptr=%p, size=%ld)\n",
+          id, ptr, size);
+  FLUKE_STATS_ADD(violations, 1);
+  if (__fluke_trap) {
+    __fluke_trap(id);
+  }
+  abort();
+}
+
+GUEST_FN_ATTR void *fluke_memory_grow(long bytes) {
+  if (!__fluke_memory_grow || bytes <= 0) {
+    return NULL;
+  }
+
+  return __fluke_memory_grow(bytes);
+}
+
+static long fluke_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Kept through Clam's preprocessing so patch-entry can find them
+GUEST_FN_ATTR __attribute__((used)) long __fluke_entry_begin(void) {
+  return getenv("FLUKE_ENTRY_TIMES") ? fluke_now_ns() : 0;
+}
+
+// The file is opened per call after the window closes: a cached fd would
+// live in guest data, which instance reset rolls back, leaking one per call
+GUEST_FN_ATTR __attribute__((used)) void __fluke_entry_end(long start) {
+  if (!start) {
+    return;
+  }
+  long end = fluke_now_ns();
+
+  const char *path = getenv("FLUKE_ENTRY_TIMES");
+  int fd = path ? open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)
+                : -1;
+  if (fd < 0) {
+    return;
+  }
+
+  // One write per line keeps lines from concurrent instances intact
+  char line[64];
+  int len = snprintf(line, sizeof(line), "%ld %ld\n", start, end);
+  if (write(fd, line, len) < 0) {
+    perror("fluke_entry_end");
+  }
+  close(fd);
+}
+
+static long fluke_page_round(long len) {
+  long size = len > 0 ? len : 1;
+  return (size + FLUKE_PAGE_SIZE - 1) & ~(long)(FLUKE_PAGE_SIZE - 1);
+}
+
+// Maps a file into the sandbox heap, so guests scan it with ordinary checked
+// loads. Without the hostcall the file is read into the same buffer instead.
+GUEST_FN_ATTR const void *fluke_map_file(const char *path, long *len,
+                                         int *mapped) {
+  // Runtime code is not instrumented, so check guest pointers by hand
+  len = (long *)__bounds_check(len, sizeof(*len), 0);
+  if (mapped) {
+    mapped = (int *)__bounds_check(mapped, sizeof(*mapped), 0);
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+
+  long size = fluke_page_round(st.st_size);
+  char *buf = aligned_alloc(FLUKE_PAGE_SIZE, size);
+  if (!buf) {
+    close(fd);
+    return NULL;
+  }
+
+  int err = ENOSYS;
+  if (__fluke_map_file) {
+    err = __fluke_map_file(fd, buf, size);
+  }
+
+  if (err) {
+    long done = 0;
+    while (done < st.st_size) {
+      ssize_t n = read(fd, buf + done, st.st_size - done);
+      if (n <= 0) {
+        free(buf);
+        close(fd);
+        return NULL;
+      }
+      done += n;
+    }
+  }
+
+  close(fd);
+  *len = st.st_size;
+  if (mapped) {
+    *mapped = !err;
+  }
+  return buf;
+}
+
+GUEST_FN_ATTR void fluke_unmap_file(const void *ptr, long len) {
+  if (!ptr) {
+    return;
+  }
+  long size = fluke_page_round(len);
+  ptr = __bounds_check(ptr, size, 0);
+
+  // The mapping is read-only, so it goes back to anonymous memory before
+  // the allocator reuses it; if that fails the range is leaked instead
+  if (__fluke_unmap_file) {
+    if (__fluke_unmap_file((void *)ptr, size)) {
+      return;
+    }
+  }
+  free((void *)ptr);
+}
+
+// Shared pages of a channel: counters, slot lengths, then the slots. Only
+// counters and lengths are read back from shared memory; the geometry stays
+// in the private handle, so a misbehaving peer can stall the ring but cannot
+// move accesses outside it.
+struct fluke_ring {
+  _Alignas(FLUKE_CACHE_LINE) unsigned long head; // slots committed
+  _Alignas(FLUKE_CACHE_LINE) unsigned long tail; // slots released
+  _Alignas(FLUKE_CACHE_LINE) unsigned long done;
+  _Alignas(FLUKE_CACHE_LINE) long lens[];
+};
+
+struct fluke_channel {
+  struct fluke_ring *ring;
+  char *slots_base;
+  long size;
+  long slots;
+  long slot_size;
+  long stride;
+  unsigned long pos; // next slot this end writes or reads
+};
+
+// Rounds len up to whole cache lines; returns nonzero on overflow
+static int fluke_line_round(long len, long *out) {
+  if (__builtin_add_overflow(len, FLUKE_CACHE_LINE - 1, out)) {
+    return 1;
+  }
+  *out &= ~(long)(FLUKE_CACHE_LINE - 1);
+  return 0;
+}
+
+// Peers usually answer within a few hundred cycles; past that, give the core
+// to them rather than burn it
+static void fluke_channel_wait(int *spins) {
+  if (++*spins < FLUKE_CHANNEL_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else {
+    *spins = 0;
+    sched_yield();
+  }
+}
+
+GUEST_FN_ATTR struct fluke_channel *fluke_channel_open(const char *name,
+                                                       long slots,
+                                                       long slot_size) {
+  if (!__fluke_channel_map || slots <= 0 || slot_size <= 0) {
+    return NULL;
+  }
+
+  long stride, header, body;
+  if (fluke_line_round(slot_size, &stride) ||
+      __builtin_mul_overflow(slots, (long)sizeof(long), &header) ||
+      __builtin_add_overflow(header, (long)sizeof(struct fluke_ring),
+                             &header) ||
+      fluke_line_round(header, &header) ||
+      __builtin_mul_overflow(slots, stride, &body) ||
+      __builtin_add_overflow(header, body, &body) ||
+      body > LONG_MAX - FLUKE_PAGE_SIZE) {
+    return NULL;
+  }
+
+  struct fluke_channel *ch = malloc(sizeof(*ch));
+  if (!ch) {
+    return NULL;
+  }
+  ch->size = fluke_page_round(body);
+  ch->ring = aligned_alloc(FLUKE_PAGE_SIZE, ch->size);
+  if (!ch->ring) {
+    free(ch);
+    return NULL;
+  }
+
+  if (__fluke_channel_map(name, ch->ring, ch->size)) {
+    free(ch->ring);
+    free(ch);
+    return NULL;
+  }
+
+  ch->slots_base = (char *)ch->ring + header;
+  ch->slots = slots;
+  ch->slot_size = slot_size;
+  ch->stride = stride;
+  ch->pos = 0;
+  return ch;
+}
+
+// Runtime code is not instrumented, and the handle lives in guest memory
+// where the guest can overwrite it, so the handle and every ring field are
+// masked before use
+static struct fluke_channel *fluke_channel_check(struct fluke_channel *ch) {
+  return (struct fluke_channel *)__bounds_check(ch, sizeof(*ch), 0);
+}
+
+static struct fluke_ring *fluke_channel_ring(struct fluke_channel *ch) {
+  return (struct fluke_ring *)__bounds_check(ch->ring, sizeof(*ch->ring), 0);
+}
+
+GUEST_FN_ATTR void fluke_channel_close(struct fluke_channel *ch) {
+  if (!ch) {
+    return;
+  }
+  ch = fluke_channel_check(ch);
+
+  // The pages stay shared with the peer until unmapped, so they are only
+  // handed back to the allocator once the loader has replaced them
+  if (__fluke_unmap_file && !__fluke_unmap_file(ch->ring, ch->size)) {
+    free(ch->ring);
+  }
+  free(ch);
+}
+
+static long *fluke_channel_len(struct fluke_channel *ch) {
+  struct fluke_ring *ring = fluke_channel_ring(ch);
+  return (long *)__bounds_check(&ring->lens[ch->pos % ch->slots],
+                                sizeof(long), 0);
+}
+
+static char *fluke_channel_slot(struct fluke_channel *ch) {
+  return ch->slots_base + (long)(ch->pos % ch->slots) * ch->stride;
+}
+
+GUEST_FN_ATTR void *fluke_channel_reserve(struct fluke_channel *ch) {
+  ch = fluke_channel_check(ch);
+  struct fluke_ring *ring = fluke_channel_ring(ch);
+  int spins = 0;
+  while (ch->pos - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+         (unsigned long)ch->slots) {
+    fluke_channel_wait(&spins);
+  }
+  return fluke_channel_slot(ch);
+}
+
+GUEST_FN_ATTR void fluke_channel_commit(struct fluke_channel *ch, long len) {
+  ch = fluke_channel_check(ch);
+  *fluke_channel_len(ch) = len;
+  ch->pos++;
+  __atomic_store_n(&fluke_channel_ring(ch)->head, ch->pos, __ATOMIC_RELEASE);
+}
+
+GUEST_FN_ATTR void fluke_channel_finish(struct fluke_channel *ch) {
+  ch = fluke_channel_check(ch);
+  __atomic_store_n(&fluke_channel_ring(ch)->done, 1, __ATOMIC_RELEASE);
+}
+
+GUEST_FN_ATTR const void *fluke_channel_peek(struct fluke_channel *ch,
+                                             long *len) {
+  ch = fluke_channel_check(ch);
+  len = (long *)__bounds_check(len, sizeof(*len), 0);
+  struct fluke_ring *ring = fluke_channel_ring(ch);
+  int spins = 0;
+  while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ch->pos) {
+    // done is published after the last commit, so recheck head once
+    if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ch->pos) {
+      return NULL;
+    }
+    fluke_channel_wait(&spins);
+  }
+
+  long n = *fluke_channel_len(ch);
+  *len = n < 0 ? 0 : n > ch->slot_size ? ch->slot_size : n;
+  return fluke_channel_slot(ch);
+}
+
+GUEST_FN_ATTR void fluke_channel_release(struct fluke_channel *ch) {
+  ch = fluke_channel_check(ch);
+  ch->pos++;
+  __atomic_store_n(&fluke_channel_ring(ch)->tail, ch->pos, __ATOMIC_RELEASE);
+}
+
+// Guest pthread_create/pthread_join resolve here instead of libc, so thread
+// stacks come from the sandbox heap rather than host mmap.
+static struct {
+  fluke_tid_t tid;
+  void *stack;
+} fluke_threads[FLUKE_MAX_THREADS];
+
+// Only the stack size is honoured. Threads must stay joinable, because
+// pthread_join is what frees their sandbox stack, and the stack always comes
+// from the sandbox heap. Anything else is refused rather than dropped.
+static int fluke_attr_supported(const pthread_attr_t *attr) {
+  int detach, inherit, scope;
+  void *stack;
+  if (pthread_attr_getdetachstate(attr, &detach) ||
+      detach != PTHREAD_CREATE_JOINABLE ||
+      pthread_attr_getinheritsched(attr, &inherit) ||
+      inherit != PTHREAD_INHERIT_SCHED || pthread_attr_getscope(attr, &scope) ||
+      scope != PTHREAD_SCOPE_SYSTEM) {
+    return 0;
+  }
+
+  size_t size;
+  return !pthread_attr_getstack(attr, &stack, &size) && stack == NULL;
+}
+
+static int fluke_thread_slot(pthread_t thread) {
+  for (int i = 0; i < FLUKE_MAX_THREADS; i++) {
+    void *stack = __atomic_load_n(&fluke_threads[i].stack, __ATOMIC_ACQUIRE);
+    if (stack != NULL && stack != (void *)1 &&
+        fluke_threads[i].tid == (fluke_tid_t)thread) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+GUEST_FN_ATTR int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                                 void *(*start)(void *), void *arg) {
+  if (!__fluke_thread_create) {
+    return ENOSYS;
+  }
+  // Runtime code is not instrumented, so check guest pointers by hand
+  thread = (pthread_t *)__bounds_check(thread, sizeof(*thread), 0);
+
+  size_t size = FLUKE_THREAD_STACK_SIZE;
+  if (attr) {
+    if (!fluke_attr_supported(attr)) {
+      return EINVAL;
+    }
+    pthread_attr_getstacksize(attr, &size);
+  }
+
+  int slot = -1;
+  for (int i = 0; i < FLUKE_MAX_THREADS; i++) {
+    void *expected = NULL;
+    if (__atomic_compare_exchange_n(&fluke_threads[i].stack, &expected,
+                                    (void *)1, 0, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED)) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    return EAGAIN;
+  }
+
+  size = (size + FLUKE_THREAD_STACK_ALIGN - 1) &
+         ~(size_t)(FLUKE_THREAD_STACK_ALIGN - 1);
+  void *stack = aligned_alloc(FLUKE_THREAD_STACK_ALIGN, size);
+  if (!stack) {
+    __atomic_store_n(&fluke_threads[slot].stack, NULL, __ATOMIC_RELEASE);
+    return EAGAIN;
+  }
+
+  fluke_tid_t tid;
+  int err = __fluke_thread_create(&tid, stack, (long)size, start, arg);
+  if (err) {
+    free(stack);
+    __atomic_store_n(&fluke_threads[slot].stack, NULL, __ATOMIC_RELEASE);
+    return err;
+  }
+
+  fluke_threads[slot].tid = tid;
+  __atomic_store_n(&fluke_threads[slot].stack, stack, __ATOMIC_RELEASE);
+  *thread = (pthread_t)tid;
+  return 0;
+}
+
+GUEST_FN_ATTR int pthread_join(pthread_t thread, void **ret) {
+  if (!__fluke_thread_join) {
+    return ENOSYS;
+  }
+  if (ret) {
+    ret = (void **)__bounds_check(ret, sizeof(*ret), 0);
+  }
+
+  int err = __fluke_thread_join((fluke_tid_t)thread, ret);
+  if (err) {
+    return err;
+  }
+
+  int slot = fluke_thread_slot(thread);
+  if (slot >= 0) {
+    free(fluke_threads[slot].stack);
+    __atomic_store_n(&fluke_threads[slot].stack, NULL, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+// A detached thread's stack would never be freed, so sandbox threads stay
+// joinable. The loader provides pthread_exit; the stack is freed by the join.
+GUEST_FN_ATTR int pthread_detach(pthread_t thread) {
+  return fluke_thread_slot(thread) >= 0 ? EINVAL : ESRCH;
 }
@@ -2,15 +2,141 @@
 #define FLUKE_H
 
 #include "clam.h"
+#include "stats.h"
 
+// The loader reserves [process_base, process_limit_max) up front and commits
+// [process_base, process_limit). Loaders that predate growable limits do not
+// export process_limit_max, in which case the reservation ends at
+// process_limit.
+//
+// Only FLUKE_GROWABLE builds let process_limit grow after startup. Elsewhere
+// it is const, so the optimizer can hoist and share its load across checks,
+// and loaders must commit the whole reservation before running the guest.
 extern const void *const process_base;
+#ifdef FLUKE_GROWABLE
+extern const void *process_limit;
+#else
 extern const void *const process_limit;
+#endif
+extern const void *const process_limit_max __attribute__((weak));
+
+#define FLUKE_RESERVED_LIMIT                                                   \
+  ((long)(&process_limit_max ? process_limit_max : process_limit))
+
+// Fixed-address builds bake the reservation into every check as immediates.
+// Checks then cover the whole reservation, so an access past the committed
+// limit faults in the reserved tail instead of being masked.
+#ifdef FLUKE_FIXED_BASE
+#ifndef FLUKE_FIXED_LIMIT
+#error "FLUKE_FIXED_BASE requires FLUKE_FIXED_LIMIT"
+#endif
+#define FLUKE_BASE ((long)(FLUKE_FIXED_BASE))
+#define FLUKE_LIMIT ((long)(FLUKE_FIXED_LIMIT))
+#define FLUKE_LIMIT_MAX FLUKE_LIMIT
+#else
+#define FLUKE_BASE ((long)process_base)
+#define FLUKE_LIMIT ((long)process_limit)
+#define FLUKE_LIMIT_MAX FLUKE_RESERVED_LIMIT
+#endif
 
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
 #define BOUNDS_FN_ATTR                                                         \
   __attribute__((always_inline)) __attribute__((visibility("hidden")))
-BOUNDS_FN_ATTR const void *__bounds_check(const void *ptr, long size);
+BOUNDS_FN_ATTR const void *__bounds_check(const void *ptr, long size, long id);
+BOUNDS_FN_ATTR long __bounds_check_len(const void *ptr, long len, long id);
 BOUNDS_FN_ATTR void __bounds_assume(const void *ptr, long size);
 
+// Shared out-of-line handler for FLUKE_TRAP builds
+#define COLD_FN_ATTR                                                           \
+  __attribute__((cold, noinline, noreturn)) __attribute__((visibility("hidden")))
+COLD_FN_ATTR void __bounds_violation(const void *ptr, long size, long id);
+
+// Optional loader hook to terminate a single instance
+extern void __fluke_trap(long id) __attribute__((weak, noreturn));
+
+// Loader hostcalls for guest threads. The loader starts an ordinary host
+// thread, so its descriptor and static TLS stay in host memory, and runs
+// start on the given sandbox-resident stack. It must reject stack, tid and
+// ret ranges outside [process_base, process_limit) and tids it did not issue.
+typedef unsigned long fluke_tid_t;
+extern int __fluke_thread_create(fluke_tid_t *tid, void *stack, long size,
+                                 void *(*start)(void *), void *arg)
+    __attribute__((weak));
+extern int __fluke_thread_join(fluke_tid_t tid, void **ret)
+    __attribute__((weak));
+
+// Loader hostcall committing `bytes` more of the reservation for the guest's
+// own use. Returns the start of the new range, which nothing else in the
+// sandbox hands out, or NULL if the reservation is exhausted.
+extern void *__fluke_memory_grow(long bytes) __attribute__((weak));
+
+// Loader hostcalls mapping a read-only file over a page-aligned range of
+// [process_base, process_limit) and restoring it to anonymous memory. The
+// loader must reject ranges outside [process_base, process_limit) with
+// EINVAL, since guests can pass any address. Both return 0 or an errno value.
+extern int __fluke_map_file(int fd, void *addr, long size)
+    __attribute__((weak));
+extern int __fluke_unmap_file(void *addr, long size) __attribute__((weak));
+
+// Loader hostcall mapping the shared pages of channel `name` over a
+// page-aligned range of [process_base, process_limit). Instances the loader
+// granted the same name see the same pages, each inside its own region, so
+// their bounds checks accept the window unchanged. The loader must reject
+// ranges outside [process_base, process_limit) with EINVAL, since the runtime
+// passes it addresses read from guest memory. Returns 0 or an errno value
+// (EPERM for names not granted); __fluke_unmap_file releases it.
+extern int __fluke_channel_map(const char *name, void *addr, long size)
+    __attribute__((weak));
+
+// Per-instance stats block the loader binds into its shared segment
+extern struct fluke_stats __fluke_stats __attribute__((weak));
+
+#define FLUKE_STATS_ADD(field, n)                                              \
+  do {                                                                         \
+    if (&__fluke_stats) {                                                      \
+      __atomic_fetch_add(&__fluke_stats.field, (n), __ATOMIC_RELAXED);         \
+    }                                                                          \
+  } while (0)
+
+#define GUEST_FN_ATTR __attribute__((visibility("hidden")))
+
+// Only a hook: the runtime has no allocator of its own, so nothing here calls
+// it. Guests managing their own arenas use it to extend them; the guest's
+// malloc grows the heap through whatever the loader provides.
+GUEST_FN_ATTR void *fluke_memory_grow(long bytes);
+// *mapped (if non-null) reports whether the file was mapped or read
+GUEST_FN_ATTR const void *fluke_map_file(const char *path, long *len,
+                                         int *mapped);
+GUEST_FN_ATTR void fluke_unmap_file(const void *ptr, long len);
+
+// Single-producer, single-consumer ring of fixed-size slots in a shared
+// channel. Both ends must open the same name with the same geometry. Slots
+// are written and read in place: reserve/commit on the producer side,
+// peek/release on the consumer side. peek returns NULL once the producer has
+// called finish and the ring is drained.
+struct fluke_channel;
+GUEST_FN_ATTR struct fluke_channel *fluke_channel_open(const char *name,
+                                                       long slots,
+                                                       long slot_size);
+GUEST_FN_ATTR void fluke_channel_close(struct fluke_channel *ch);
+GUEST_FN_ATTR void *fluke_channel_reserve(struct fluke_channel *ch);
+GUEST_FN_ATTR void fluke_channel_commit(struct fluke_channel *ch, long len);
+GUEST_FN_ATTR void fluke_channel_finish(struct fluke_channel *ch);
+GUEST_FN_ATTR const void *fluke_channel_peek(struct fluke_channel *ch,
+                                             long *len);
+GUEST_FN_ATTR void fluke_channel_release(struct fluke_channel *ch);
+
+// Hooks patch-entry wraps around the exported entry. With FLUKE_ENTRY_TIMES
+// set, each call appends "<start_ns> <end_ns>" (CLOCK_MONOTONIC) to that file.
+GUEST_FN_ATTR long __fluke_entry_begin(void);
+GUEST_FN_ATTR void __fluke_entry_end(long start);
+
+#define FLUKE_PAGE_SIZE 4096
+#define FLUKE_CACHE_LINE 64
+#define FLUKE_CHANNEL_SPINS 1024
+#define FLUKE_THREAD_STACK_SIZE (1L << 20)
+#define FLUKE_THREAD_STACK_ALIGN FLUKE_PAGE_SIZE
+#define FLUKE_MAX_THREADS 256
+
 #endif
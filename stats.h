@@ -0,0 +1,33 @@
+#ifndef FLUKE_STATS_H
+#define FLUKE_STATS_H
+
+// Each loader publishes one shared memory segment, FLUKE_STATS_NAME formatted
+// with its pid: a header followed by `slots` per-instance blocks. Writers use
+// relaxed atomics, so readers may see a block mid-update but never block it.
+#define FLUKE_STATS_NAME "/fluke-stats-%d"
+#define FLUKE_STATS_MAGIC 0x464c4b53u
+#define FLUKE_STATS_VERSION 1u
+
+struct fluke_stats_header {
+  unsigned magic;
+  unsigned version;
+  unsigned slots;
+  unsigned reserved;
+} __attribute__((aligned(64)));
+
+// One cache line per instance. The loader owns everything but violations,
+// which the runtime adds: heap_bytes is how far the guest heap extends, and
+// hostcalls counts the calls the guest made into host functions through its
+// PLT or import table.
+struct fluke_stats {
+  unsigned long pid;
+  unsigned long entries;
+  unsigned long wall_ns;
+  unsigned long cpu_ns;
+  unsigned long heap_bytes;
+  unsigned long hostcalls;
+  unsigned long violations;
+  unsigned long reserved;
+} __attribute__((aligned(64)));
+
+#endif
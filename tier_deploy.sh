@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Publish each program's checked _lib.so right away, then swap in the
+# verified _clam.so as Clam finishes, running at most DEPLOY_JOBS Clam builds
+# at once. Returns once every build has finished.
+#
+#   DEPLOY_DIR=deploy DEPLOY_JOBS=4 ./tier_deploy.sh <program>...
+#
+# <deploy-dir>/<program>.so always points at a complete build and is replaced
+# with rename(2), so a loader opening it sees either tier, never a mix.
+# Loaders that already opened it keep the build they loaded.
+# <deploy-dir>/<program>.tier names the tier currently published.
+
+DEPLOY_DIR="${DEPLOY_DIR:-deploy}"
+DEPLOY_JOBS="${DEPLOY_JOBS:-$(nproc)}"
+DIR=programs
+
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 <program>..."
+    exit 1
+fi
+
+mkdir -p "$DEPLOY_DIR"
+
+publish() {
+    local prog="$1" src="$2" tier="$3"
+    local tmp="$DEPLOY_DIR/.$prog.so.$$"
+
+    cp "$src" "$tmp" && mv -f "$tmp" "$DEPLOY_DIR/$prog.so" || return 1
+    echo "$tier" > "$DEPLOY_DIR/.$prog.tier.$$"
+    mv -f "$DEPLOY_DIR/.$prog.tier.$$" "$DEPLOY_DIR/$prog.tier"
+    echo "FLUKE: published $prog ($tier)"
+}
+
+# A loader that opens the path later binds whichever tier is live, so both
+# builds must agree on exported functions, and exported data with sizes.
+exports() {
+    nm -D --defined-only -S "$1" |
+        awk '$(NF-1) ~ /^[BDRV]$/ { print $NF, $2; next } { print $NF }' |
+        sort
+}
+
+compatible() {
+    cmp -s <(exports "$1") <(exports "$2")
+}
+
+verify() {
+    local prog="$1"
+
+    if ! make "$DIR/${prog}_clam.so" > "$DEPLOY_DIR/$prog.clam.log" 2>&1; then
+        echo "FLUKE: clam build failed for $prog, staying on lib"
+    elif ! compatible "$DIR/${prog}_lib.so" "$DIR/${prog}_clam.so"; then
+        echo "FLUKE: $prog clam build is not interchangeable, staying on lib"
+    else
+        publish "$prog" "$DIR/${prog}_clam.so" clam
+    fi
+}
+
+for prog in "$@"; do
+    make "$DIR/${prog}_lib.so" || exit 1
+    publish "$prog" "$DIR/${prog}_lib.so" lib || exit 1
+done
+
+for prog in "$@"; do
+    while [ "$(jobs -rp | wc -l)" -ge "$DEPLOY_JOBS" ]; do
+        wait -n
+    done
+    verify "$prog" &
+    echo "FLUKE: verifying $prog (pid $!)"
+done
+wait